@@ -4,18 +4,19 @@
 #include <boost/asio.hpp>
 #include <thread>
 #include <chrono>
-#include <iostream>
-#include <sstream>
+#include "logging/logger.hpp"
+#include <algorithm>
+#include <cstring>
 
 // Implementation file for AntiEntropyManager
 // All methods are implemented inline in the header for simplicity.
 // If needed, move method implementations here from the header.
 
 AntiEntropyManager::AntiEntropyManager(boost::asio::io_context& io_context, KeyValueStore& kv_store,
-                                       const std::string& peer_host, short peer_port,
+                                       Membership& membership,
                                        std::shared_ptr<IndexInterface> merkle_index,
                                        SyncMode mode)
-    : io_context_(io_context), kv_store_(kv_store), peer_host_(peer_host), peer_port_(peer_port), sync_mode_(mode), merkle_index_(merkle_index) {}
+    : io_context_(io_context), kv_store_(kv_store), membership_(membership), sync_mode_(mode), merkle_index_(merkle_index) {}
 
 void AntiEntropyManager::start() {
     anti_entropy_thread_ = std::thread([this]() {
@@ -23,124 +24,328 @@ void AntiEntropyManager::start() {
             try {
                 run_anti_entropy();
             } catch (const std::exception& e) {
-                std::cerr << "Anti-entropy error: " << e.what() << std::endl;
+                KV_LOG_WARN("Anti-entropy error: " << e.what());
             }
             std::this_thread::sleep_for(std::chrono::seconds(5));
         }
     });
 }
 
+// Partitions are whole steps of the top-down diff, so both sides split the levels alike
+static_assert(HashRing::partition_bits % AntiEntropyManager::fan_out_bits == 0);
+
+std::vector<merkle::Hash> AntiEntropyManager::fetch_range_hashes(tcp::socket& socket, FrameReader& reader) {
+    constexpr size_t hash_size = sizeof(merkle::Hash::bytes);
+    std::vector<size_t> nodes = {0};
+    std::vector<merkle::Hash> hashes;
+    for (size_t level = 0; level < HashRing::partition_bits; level += fan_out_bits) {
+        std::string ids;
+        binary_protocol::append_u32(ids, static_cast<uint32_t>(level));
+        for (size_t node : nodes) binary_protocol::append_u32(ids, static_cast<uint32_t>(node));
+        std::string frame;
+        binary_protocol::encode_request(frame, binary_protocol::OP_MERKLE_LEVEL, "", ids);
+        boost::asio::write(socket, boost::asio::buffer(frame));
+
+        std::string_view peer_hashes;
+        if (reader.read_frame(peer_hashes) != binary_protocol::STATUS_OK) {
+            throw std::runtime_error("peer has no Merkle index");
+        }
+        if (peer_hashes.size() != (nodes.size() << fan_out_bits) * hash_size) {
+            throw std::runtime_error("peer's Merkle tree has a different shape");
+        }
+        hashes.resize(peer_hashes.size() / hash_size);
+        for (size_t i = 0; i < hashes.size(); i++) {
+            std::memcpy(hashes[i].bytes, peer_hashes.data() + i * hash_size, hash_size);
+        }
+        nodes.resize(hashes.size());
+        for (size_t i = 0; i < nodes.size(); i++) nodes[i] = i;
+    }
+    return hashes;
+}
+
+std::vector<size_t> AntiEntropyManager::find_differing_buckets(tcp::socket& socket, FrameReader& reader, size_t level,
+                                                               std::vector<size_t> frontier) {
+    size_t depth = merkle_index_->depth();
+
+    while (level < depth && !frontier.empty()) {
+        size_t span = std::min(fan_out_bits, depth - level);
+        size_t width = size_t(1) << span;
+        std::vector<size_t> next;
+
+        for (size_t start = 0; start < frontier.size(); start += max_nodes_per_request) {
+            std::vector<size_t> nodes(frontier.begin() + start,
+                                      frontier.begin() + std::min(start + max_nodes_per_request, frontier.size()));
+            std::string ids;
+            binary_protocol::append_u32(ids, static_cast<uint32_t>(level));
+            for (size_t node : nodes) binary_protocol::append_u32(ids, static_cast<uint32_t>(node));
+            std::string frame;
+            binary_protocol::encode_request(frame, binary_protocol::OP_MERKLE_LEVEL, "", ids);
+            boost::asio::write(socket, boost::asio::buffer(frame));
+
+            std::string_view peer_hashes;
+            if (reader.read_frame(peer_hashes) != binary_protocol::STATUS_OK) {
+                throw std::runtime_error("peer has no Merkle index");
+            }
+            auto local_hashes = merkle_index_->get_subtree_hashes(level, nodes, span);
+            constexpr size_t hash_size = sizeof(merkle::Hash::bytes);
+            for (size_t i = 0; i < local_hashes.size() && (i + 1) * hash_size <= peer_hashes.size(); i++) {
+                if (std::memcmp(local_hashes[i].bytes, peer_hashes.data() + i * hash_size, hash_size) != 0) {
+                    next.push_back(nodes[i / width] * width + i % width);
+                }
+            }
+        }
+        frontier.swap(next);
+        level += span;
+    }
+    return level == depth ? frontier : std::vector<size_t>();
+}
+
+size_t AntiEntropyManager::sync_buckets(tcp::socket& socket, FrameReader& reader, const std::vector<size_t>& buckets) {
+    std::unordered_map<std::string, IndexInterface::BucketEntry> local_entries;
+    for (auto& entry : merkle_index_->get_bucket_entries(buckets)) {
+        local_entries.emplace(entry.key, std::move(entry));
+    }
+
+    std::string ids;
+    for (size_t bucket : buckets) binary_protocol::append_u32(ids, static_cast<uint32_t>(bucket));
+    std::string frame;
+    binary_protocol::encode_request(frame, binary_protocol::OP_GET_BUCKETS, "", ids);
+    boost::asio::write(socket, boost::asio::buffer(frame));
+
+    // Pull what the peer has newer or we lack, and equal-timestamp entries whose contents
+    // differ so the merge can settle the tie. Keys where we are newer are left to the
+    // peer's own round.
+    std::string wanted;
+    size_t wanted_count = 0;
+    reader.read_stream([&](std::string_view chunk) {
+        return binary_protocol::for_each_bucket_entry(chunk, [&](std::string_view key, uint64_t peer_ts, uint64_t digest) {
+            auto it = local_entries.find(std::string(key));
+            if (it == local_entries.end() || it->second.timestamp < peer_ts ||
+                (it->second.timestamp == peer_ts && it->second.digest != digest)) {
+                binary_protocol::append_key(wanted, key);
+                wanted_count++;
+            }
+        });
+    });
+    if (wanted_count == 0) {
+        return 0;
+    }
+
+    // Fetch values and tombstones with their original timestamps and merge them last-write-wins
+    frame.clear();
+    binary_protocol::encode_request(frame, binary_protocol::OP_GET_ENTRIES, "", wanted);
+    boost::asio::write(socket, boost::asio::buffer(frame));
+    size_t merged = 0;
+    reader.read_stream([&](std::string_view chunk) {
+        return binary_protocol::for_each_entry(chunk, [&](const binary_protocol::EntryRecord& record) {
+            std::string key(record.key);
+            if (record.tombstone() ? kv_store_.merge_tombstone(key, record.timestamp)
+                                   : kv_store_.merge(key, std::string(record.value), record.timestamp, record.expire_at)) {
+                merged++;
+            }
+        });
+    });
+    return merged;
+}
+
+size_t AntiEntropyManager::transfer_partition(tcp::socket& socket, FrameReader& reader, size_t partition) {
+    std::string value;
+    binary_protocol::append_u32(value, static_cast<uint32_t>(partition));
+    std::string frame;
+    binary_protocol::encode_request(frame, binary_protocol::OP_TRANSFER, "", value);
+    boost::asio::write(socket, boost::asio::buffer(frame));
+
+    // The sender makes the next chunk only once the last has been written, so pausing
+    // here holds it back too. Neither the sender's io threads nor this node's store spend
+    // more than the transfer rate on the partition, and client requests keep their latency.
+    size_t rate = membership_.config().transfer_rate;
+    auto started = std::chrono::steady_clock::now();
+    uint64_t received = 0;
+    size_t merged = 0;
+    reader.read_stream([&](std::string_view chunk) {
+        bool valid = binary_protocol::for_each_entry(chunk, [&](const binary_protocol::EntryRecord& record) {
+            std::string key(record.key);
+            if (record.tombstone() ? kv_store_.merge_tombstone(key, record.timestamp)
+                                   : kv_store_.merge(key, std::string(record.value), record.timestamp, record.expire_at)) {
+                merged++;
+            }
+        });
+        received += chunk.size();
+        if (rate > 0) {
+            std::this_thread::sleep_until(started + std::chrono::microseconds(received * 1000000 / rate));
+        }
+        return valid;
+    });
+    return merged;
+}
+
 void AntiEntropyManager::run_anti_entropy() {
-    std::cout << "[AntiEntropy] Running anti-entropy sync..." << std::endl;
-    // 1. Get local Merkle root
+    KV_LOG_DEBUG("[AntiEntropy] Running anti-entropy sync...");
+    uint64_t round_started = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const auto& config = membership_.config();
+    auto live = membership_.live_members();
+    std::vector<ClusterConfig::Address> nodes = {config.self};
+    for (const auto& member : live) nodes.push_back(member.address);
+    HashRing ring(std::move(nodes), config.vnodes, config.replication_factor);
+
+    std::vector<size_t> confirmed(HashRing::partitions);
+    for (const auto& member : live) {
+        try {
+            if (sync_with(member, ring, confirmed)) {
+                converged_at_[member.address.to_string()] = round_started;
+            }
+        } catch (const std::exception& e) {
+            KV_LOG_WARN("Anti-entropy with " << member.address.to_string() << " failed: " << e.what());
+        }
+    }
+
+    // A partition handed off to other nodes goes once every one of them holds the same
+    for (size_t partition = 0; partition < HashRing::partitions; partition++) {
+        size_t owners = ring.owners(partition).size();
+        if (!ring.owns(config.self, partition) && owners > 0 && confirmed[partition] == owners) {
+            size_t dropped = drop_partition(partition);
+            KV_LOG_INFO("[AntiEntropy] Handed off partition " << partition << ", dropped " << dropped << " keys");
+        }
+    }
+    update_gc_horizon(round_started);
+}
+
+void AntiEntropyManager::update_gc_horizon(uint64_t round_started) {
+    auto members = membership_.members();
+    if (members.empty()) {
+        return;
+    }
+    // Collect tombstones only as far as every member, dead ones included, has caught up
+    uint64_t converged = round_started;
+    for (const auto& member : members) {
+        auto it = converged_at_.find(member.address.to_string());
+        converged = std::min(converged, it == converged_at_.end() ? 0 : it->second);
+    }
+    uint64_t safe_point = converged > gc_lag_ms ? converged - gc_lag_ms : 0;
+    safe_point_.store(safe_point, std::memory_order_relaxed);
+
+    uint64_t horizon = safe_point;
+    for (const auto& member : members) {
+        auto it = peer_safe_points_.find(member.address.to_string());
+        horizon = std::min(horizon, it == peer_safe_points_.end() ? 0 : it->second);
+    }
+    if (horizon > 0) {
+        kv_store_.advance_gc_horizon(horizon);
+    }
+}
+
+size_t AntiEntropyManager::drop_partition(size_t partition) {
+    size_t shift = merkle_index_->depth() - HashRing::partition_bits;
+    std::vector<size_t> buckets;
+    for (size_t bucket = partition << shift; bucket < (partition + 1) << shift; bucket++) {
+        buckets.push_back(bucket);
+    }
+    size_t dropped = 0;
+    for (const auto& entry : merkle_index_->get_bucket_entries(buckets)) {
+        dropped += kv_store_.drop(entry.key);
+    }
+    return dropped;
+}
+
+bool AntiEntropyManager::sync_with(const Membership::Member& member, const HashRing& ring,
+                                   std::vector<size_t>& confirmed) {
+    // 1. Get local Merkle root and partition hashes
     auto local_index = std::dynamic_pointer_cast<MerkleTreeIndex>(merkle_index_);
     if (!local_index) {
-        std::cout << "[AntiEntropy] Local Merkle index not available." << std::endl;
-        return;
+        KV_LOG_DEBUG("[AntiEntropy] Local Merkle index not available.");
+        return false;
     }
     auto local_root = local_index->get_root_hash();
-    std::cout << "[AntiEntropy] Local Merkle root: " << local_root.to_string() << std::endl;
+    auto local_ranges = local_index->get_subtree_hashes(0, {0}, HashRing::partition_bits);
+    KV_LOG_DEBUG("[AntiEntropy] Local Merkle root: " << local_root.to_string());
 
-    // 2. Connect to peer and get their Merkle root
+    // 2. Connect to the member over the binary protocol and get their Merkle root
+    const auto& peer = member.address;
     boost::asio::io_context io_context;
     boost::asio::ip::tcp::socket socket(io_context);
-    boost::asio::ip::tcp::resolver resolver(io_context);
-    boost::asio::connect(socket, resolver.resolve(peer_host_, std::to_string(peer_port_)));
-    std::cout << "[AntiEntropy] Connected to peer " << peer_host_ << ":" << peer_port_ << std::endl;
-
-    // Send command to get peer's Merkle root
-    std::string get_root_cmd = "GET_MERKLE_ROOT";
-    boost::asio::write(socket, boost::asio::buffer(get_root_cmd));
-
-    char data[4096];
-    size_t length = socket.read_some(boost::asio::buffer(data));
-    std::string peer_root_str(data, length);
-    std::cout << "[AntiEntropy] Peer Merkle root: " << peer_root_str << std::endl;
-
-    // 3. Compare roots
-    if (peer_root_str == local_root.to_string()) {
-        std::cout << "[AntiEntropy] Merkle roots match. No sync needed." << std::endl;
-        return;
+    connect_binary(socket, peer.host, peer.port);
+    FrameReader reader(socket);
+    KV_LOG_DEBUG("[AntiEntropy] Connected to peer " << peer.to_string());
+
+    std::string frame;
+    binary_protocol::encode_request(frame, binary_protocol::OP_MERKLE_ROOT, "");
+    boost::asio::write(socket, boost::asio::buffer(frame));
+    std::string_view peer_root;
+    reader.read_frame(peer_root);
+    constexpr size_t hash_size = sizeof(local_root.bytes);
+    if (peer_root.size() >= hash_size + 8) {
+        peer_safe_points_[peer.to_string()] = binary_protocol::load_u64(peer_root.data() + hash_size);
+    }
+
+    // 3. Equal roots mean equal partitions; otherwise fetch the peer's partition hashes
+    std::vector<merkle::Hash> peer_ranges;
+    if (peer_root.size() >= hash_size && std::memcmp(peer_root.data(), local_root.bytes, hash_size) == 0) {
+        KV_LOG_DEBUG("[AntiEntropy] Merkle roots match. No sync needed.");
+        peer_ranges = local_ranges;
+    } else {
+        peer_ranges = fetch_range_hashes(socket, reader);
     }
-    std::cout << "[AntiEntropy] Merkle roots differ. Sync required." << std::endl;
-
-    // 4. Get all keys with timestamps from peer
-    std::string get_all_cmd = "GET_ALL";
-    boost::asio::write(socket, boost::asio::buffer(get_all_cmd));
-    length = socket.read_some(boost::asio::buffer(data));
-    std::string peer_keys_str(data, length);
-    std::cout << "[AntiEntropy] Peer keys: " << peer_keys_str << std::endl;
-
-    // Parse peer keys
-    std::vector<std::string> peer_keys;
-    std::istringstream iss(peer_keys_str);
-    std::string key_ts;
-    while (std::getline(iss, key_ts, ';')) {
-        if (!key_ts.empty()) {
-            auto pos = key_ts.find(':');
-            if (pos != std::string::npos) {
-                peer_keys.push_back(key_ts.substr(0, pos));
+
+    // 4. Compare partition by partition. Those this node owns are pulled from any member
+    // holding something else, owner or not, so a partition that changed hands reaches its
+    // new owners from the old ones. One this node holds nothing of, as after it joined or
+    // took over from a node that left, is streamed whole. Those it no longer owns are
+    // pulled from their owners only.
+    const merkle::Hash empty;
+    const auto& self = membership_.config().self;
+    bool converged = true;
+    std::vector<size_t> differing;
+    std::vector<size_t> gained;
+    for (size_t partition = 0; partition < HashRing::partitions; partition++) {
+        bool mine = ring.owns(self, partition);
+        bool theirs = ring.owns(peer, partition);
+        if (local_ranges[partition] == peer_ranges[partition]) {
+            if (!mine && theirs && !(local_ranges[partition] == empty)) {
+                confirmed[partition]++;
             }
+            continue;
         }
-    }
-    std::cout << "[AntiEntropy] Parsed peer keys: ";
-    for (const auto& k : peer_keys) std::cout << k << " ";
-    std::cout << std::endl;
-
-    // 5. Request Merkle paths for these keys from peer
-    std::string get_paths_cmd = "GET_PATHS ";
-    for (const auto& k : peer_keys) get_paths_cmd += k + ";";
-    boost::asio::write(socket, boost::asio::buffer(get_paths_cmd));
-    length = socket.read_some(boost::asio::buffer(data));
-    std::string peer_paths_str(data, length);
-    std::cout << "[AntiEntropy] Peer paths: " << peer_paths_str << std::endl;
-
-    // Parse peer paths (format: key,hexpath;key,hexpath;...)
-    std::vector<std::vector<uint8_t>> peer_paths;
-    std::vector<std::string> keys_for_paths;
-    std::istringstream pss(peer_paths_str);
-    std::string key_path;
-    while (std::getline(pss, key_path, ';')) {
-        if (!key_path.empty()) {
-            auto comma = key_path.find(',');
-            if (comma != std::string::npos) {
-                keys_for_paths.push_back(key_path.substr(0, comma));
-                std::string hexpath = key_path.substr(comma + 1);
-                std::vector<uint8_t> path_bytes;
-                for (size_t i = 0; i + 1 < hexpath.size(); i += 2) {
-                    std::string byte_str = hexpath.substr(i, 2);
-                    path_bytes.push_back(static_cast<uint8_t>(std::stoi(byte_str, nullptr, 16)));
-                }
-                peer_paths.push_back(path_bytes);
+        if (!mine) {
+            // A partition handed off is still caught up from its owners, so once writes to
+            // it stop reaching this node it comes to match them and can be dropped
+            if (theirs && !(local_ranges[partition] == empty)) {
+                differing.push_back(partition);
             }
+            continue;
         }
+        // Unless the peer is neither owner nor holder, it lacks something or holds more
+        converged = converged && !theirs && peer_ranges[partition] == empty;
+        if (peer_ranges[partition] == empty) {
+            continue;
+        }
+        (local_ranges[partition] == empty ? gained : differing).push_back(partition);
+    }
+    for (size_t partition : gained) {
+        auto started = std::chrono::steady_clock::now();
+        size_t merged = transfer_partition(socket, reader, partition);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+        KV_LOG_INFO("[AntiEntropy] Transferred partition " << partition << " from " << peer.to_string() << ": "
+                    << merged << " entries in " << elapsed.count() << " ms");
+    }
+    if (differing.empty()) {
+        return converged;
+    }
+    KV_LOG_INFO("[AntiEntropy] " << differing.size() << " partitions differ from " << peer.to_string()
+                << ". Sync required.");
+
+    // 5. Descend only into subtrees whose hashes differ, down to the leaf buckets
+    std::vector<size_t> differing_buckets = find_differing_buckets(socket, reader, HashRing::partition_bits,
+                                                                   std::move(differing));
+    KV_LOG_INFO("[AntiEntropy] " << differing_buckets.size() << " differing buckets");
+
+    // 6. Compare those buckets' entries and pull newer keys, a bounded batch at a time
+    size_t merged = 0;
+    for (size_t start = 0; start < differing_buckets.size(); start += buckets_per_batch) {
+        std::vector<size_t> batch(differing_buckets.begin() + start,
+                                  differing_buckets.begin() + std::min(start + buckets_per_batch, differing_buckets.size()));
+        merged += sync_buckets(socket, reader, batch);
     }
-    std::cout << "[AntiEntropy] Parsed peer paths for keys: ";
-    for (const auto& k : keys_for_paths) std::cout << k << " ";
-    std::cout << std::endl;
-
-    // Get local paths for these keys
-    auto local_paths = local_index->get_paths(keys_for_paths);
-
-    // Compare paths using MerkleTreeIndex::find_differences
-    std::vector<merkle::Path> remote_merkle_paths;
-    for (const auto& bytes : peer_paths) {
-        remote_merkle_paths.emplace_back(bytes);
-    }
-    std::vector<std::string> differing_keys = local_index->find_differences(remote_merkle_paths, keys_for_paths);
-    std::cout << "[AntiEntropy] Differing keys: ";
-    for (const auto& k : differing_keys) std::cout << k << " ";
-    std::cout << std::endl;
-
-    // 6. For each differing key, request value from peer and update local store
-    for (const auto& key : differing_keys) {
-        std::string get_cmd = "GET " + key;
-        boost::asio::write(socket, boost::asio::buffer(get_cmd));
-        length = socket.read_some(boost::asio::buffer(data));
-        std::string value(data, length);
-        std::cout << "[AntiEntropy] Updating key '" << key << "' with value '" << value << "'" << std::endl;
-        kv_store_.set(key, value, std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count());
-    }
-    std::cout << "[AntiEntropy] Sync complete." << std::endl;
+    KV_LOG_INFO("[AntiEntropy] Sync complete, merged " << merged << " newer entries.");
+    return converged;
 }
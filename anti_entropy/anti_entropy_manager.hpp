@@ -8,7 +8,12 @@
 #include <iostream>
 #include <chrono>
 #include <memory>
+#include <vector>
 #include "index_interface.hpp"
+#include "protocol/frame_reader.hpp"
+#include "cluster/membership.hpp"
+#include "cluster/hash_ring.hpp"
+#include <atomic>
 
 // Forward declarations
 class KeyValueStore;
@@ -23,26 +28,70 @@ public:
     };
 
     AntiEntropyManager(boost::asio::io_context& io_context, KeyValueStore& kv_store,
-                       const std::string& peer_host, short peer_port,
+                       Membership& membership,
                        std::shared_ptr<IndexInterface> merkle_index,
                        SyncMode mode = MERKLE_TREE);
 
+    // Each round of the top-down diff descends this many tree levels (a 16-way fan-out)
+    static constexpr size_t fan_out_bits = 4;
+    // Upper bound on tree nodes named in one request
+    static constexpr size_t max_nodes_per_request = 4096;
+    // Differing buckets whose entries are compared and pulled per round trip
+    static constexpr size_t buckets_per_batch = 256;
+    // When a round finds a member holding the same as this node in every partition this
+    // node owns, the member holds every tombstone of those partitions that this node held
+    // as the round started. Once that holds for every member, tombstones older than the
+    // oldest such round by this lag are safe to collect: that time is the node's safe
+    // point. Younger ones wait out the lag, so a delete still in flight between replicas
+    // is not collected on one side while another takes in the value it removed. A member
+    // that stays away holds collection back to the store's grace period.
+    static constexpr uint64_t gc_lag_ms = 60 * 1000;
+
     void start();
+    // One round: syncs each partition this node owns with every live member in turn, and
+    // drops the partitions it no longer owns once all their owners hold the same. A
+    // partition this node has gained and holds nothing of yet is streamed over whole
+    // instead of diffed (see transfer_partition).
     void run_anti_entropy();
+    // Sent with the Merkle root. Each node collects tombstones up to the oldest safe point
+    // of the cluster, so all replicas collect the same ones and their hashes meet again.
+    uint64_t safe_point() const { return safe_point_.load(std::memory_order_relaxed); }
     std::shared_ptr<IndexInterface> get_merkle_index() const { return merkle_index_; }
     void set_merkle_index(std::shared_ptr<IndexInterface> index) { merkle_index_ = index; }
 
 private:
-    // ... (keep existing private method declarations but remove implementations)
+    // Pulls what the member has newer in the partitions this node owns, and in those it
+    // holds but no longer owns if the member owns them; returns true if it held the same
+    // in all this node owns. Counts, per partition handed off, the owners that hold the same.
+    bool sync_with(const Membership::Member& member, const HashRing& ring, std::vector<size_t>& confirmed);
+    // The peer's hash of every partition: its Merkle subtree roots at level partition_bits
+    std::vector<merkle::Hash> fetch_range_hashes(tcp::socket& socket, FrameReader& reader);
+    // Walks down from the given nodes of level and returns the leaf buckets whose hashes
+    // differ from the peer's
+    std::vector<size_t> find_differing_buckets(tcp::socket& socket, FrameReader& reader, size_t level,
+                                               std::vector<size_t> frontier);
+    // Removes every key of a partition this node has handed off
+    size_t drop_partition(size_t partition);
+    // Moves the safe point and GC horizon on after a round
+    void update_gc_horizon(uint64_t round_started);
+    // Merges the peer's newer entries of these buckets; returns how many were applied
+    size_t sync_buckets(tcp::socket& socket, FrameReader& reader, const std::vector<size_t>& buckets);
+    // Copies a whole partition this node holds nothing of from the peer, at no more than
+    // the configured transfer rate; returns how many entries were applied
+    size_t transfer_partition(tcp::socket& socket, FrameReader& reader, size_t partition);
     
     // Private member variables
     boost::asio::io_context& io_context_;
     KeyValueStore& kv_store_;
-    std::string peer_host_;
-    short peer_port_;
+    Membership& membership_;
     SyncMode sync_mode_;
     std::shared_ptr<IndexInterface> merkle_index_;
     std::thread anti_entropy_thread_;
+    // Per member address, when the last round that found it holding the same started
+    std::unordered_map<std::string, uint64_t> converged_at_;
+    // Per member address, the safe point it last reported
+    std::unordered_map<std::string, uint64_t> peer_safe_points_;
+    std::atomic<uint64_t> safe_point_{0};
 };
 
 #endif // ANTI_ENTROPY_MANAGER_HPP
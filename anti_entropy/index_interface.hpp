@@ -3,19 +3,47 @@
 
 #include <unordered_map>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 #include "../merklecpp/merklecpp.h"
 
 class IndexInterface {
 public:
-    using KeyValueData = std::unordered_map<std::string, std::pair<std::string, uint64_t>>;
+    // One key's state as the index hashes it. A tombstone has an empty value; expire_at
+    // is 0 for a key without a TTL.
+    struct Version {
+        std::string value;
+        uint64_t timestamp = 0;
+        uint64_t expire_at = 0;
+        bool tombstone = false;
+    };
+
+    using KeyValueData = std::unordered_map<std::string, Version>;
+
+    // One leaf entry as exchanged during sync. digest summarises the whole version, so
+    // replicas can tell equal-timestamp entries with different contents apart.
+    struct BucketEntry {
+        std::string key;
+        uint64_t timestamp;
+        uint64_t digest;
+    };
     
     virtual ~IndexInterface() = default;
     virtual void rebuild(const KeyValueData& kv_data) = 0;
+    // Single-key deltas applied on every write; only the affected leaf changes
+    virtual void upsert(const std::string& key, std::string_view value, uint64_t timestamp,
+                        uint64_t expire_at, bool tombstone) = 0;
+    virtual void remove(const std::string& key) = 0;
     virtual std::unordered_map<std::string, uint64_t> get_key_timestamps() const = 0;
     virtual merkle::Hash get_root_hash() const { return merkle::Hash(); }
     virtual std::vector<merkle::Path> get_paths(const std::vector<std::string>&) const { return {}; }
+    // Top-down diff: tree levels count from the root (0) down to the leaf buckets (depth())
+    virtual size_t depth() const { return 0; }
+    // Hashes of the nodes span levels below each given node of level, in node order
+    virtual std::vector<merkle::Hash> get_subtree_hashes(size_t, const std::vector<size_t>&, size_t) const { return {}; }
+    // Every entry in the given leaf buckets
+    virtual std::vector<BucketEntry> get_bucket_entries(const std::vector<size_t>&) const { return {}; }
     virtual size_t size() const { return 0; }
     virtual bool empty() const { return true; }
 };
@@ -1,113 +1,370 @@
-#ifndef MERKLE_TREE_INDEX_HPP
+ #ifndef MERKLE_TREE_INDEX_HPP
 #define MERKLE_TREE_INDEX_HPP
 
 #include "../merklecpp/merklecpp.h"
 #include "../anti_entropy/index_interface.hpp"
 #include <string>
 #include <vector>
+#include <atomic>
+#include <list>
+#include <memory>
 #include <unordered_map>
 #include <mutex>
-#include <iostream>
+#include "../logging/logger.hpp"
+#include <cstring>
+#include <sstream>
+#include <algorithm>
 
+// Merkle tree over a fixed number of key-hash buckets. A key's leaf is chosen by its
+// hash alone and a bucket's hash is the XOR of its entries' hashes, so the layout (and
+// therefore the root) depends only on the data, never on insertion order: two nodes
+// holding the same key/value/timestamp set always produce the same root.
+//
+// Writes only touch their bucket. The buckets are split into stripes of contiguous
+// ranges, each with its own lock, so writes to different stripes never wait on each
+// other. A write updates its bucket's hash and marks the bucket dirty; the levels above
+// are rehashed when they are next read, once per changed node however many writes
+// changed it.
 class MerkleTreeIndex : public IndexInterface {
 public:
-    MerkleTreeIndex() = default;
+    static constexpr size_t max_stripe_bits = 6;
+
+    // 2^depth buckets in up to 2^max_stripe_bits stripes
+    explicit MerkleTreeIndex(size_t depth = 16)
+        : tree_depth(depth),
+          stripe_shift(depth - std::min(depth, max_stripe_bits)),
+          stripes(new Stripe[size_t(1) << std::min(depth, max_stripe_bits)]) {
+        clear_tree();
+    }
 
     void rebuild(const KeyValueData& kv_data) override {
-        std::lock_guard<std::mutex> guard(tree_mutex);
-        
+        std::lock_guard<std::mutex> levels_guard(levels_mutex);
+        std::vector<std::unique_lock<std::mutex>> stripe_guards;
+        for (size_t i = 0; i < stripe_count(); i++) {
+            stripe_guards.emplace_back(stripes[i].mutex);
+        }
+
         // Clear existing tree
-        merkle_tree = merkle::Tree();
-        key_to_index.clear();
-        
-        // Insert each key-value pair from the interface data
-        size_t index = 0;
-        for (const auto& [key, value_ts] : kv_data) {
-            auto leaf_hash = hash_key_value(key, value_ts.first, value_ts.second);
-            merkle_tree.insert(leaf_hash);
-            key_to_index[key] = index++;
-        }
-        
-        std::cout << "Rebuilt Merkle tree with " << index << " key-value pairs" << std::endl;
-    }
-    
+        clear_tree();
+
+        // Fold every key-value pair into its bucket, then hash the levels once
+        for (const auto& [key, version] : kv_data) {
+            auto entry_hash = hash_key_value(key, version.value, version.timestamp, version.expire_at, version.tombstone);
+            size_t bucket = bucket_of(key);
+            buckets[bucket][key] = {entry_hash, version.timestamp};
+            xor_into(leaves[bucket], entry_hash);
+        }
+        num_keys = kv_data.size();
+        levels[0] = leaves;
+        for (size_t level = 1; level < levels.size(); level++) {
+            for (size_t i = 0; i < levels[level].size(); i++) {
+                combine(levels[level - 1][2 * i], levels[level - 1][2 * i + 1], levels[level][i]);
+            }
+        }
+
+        KV_LOG_INFO("Rebuilt Merkle tree with " << kv_data.size() << " key-value pairs");
+    }
+
+    void upsert(const std::string& key, std::string_view value, uint64_t timestamp,
+                uint64_t expire_at, bool tombstone) override {
+        size_t bucket = bucket_of(key);
+        auto entry_hash = hash_key_value(key, value, timestamp, expire_at, tombstone);
+        Stripe& stripe = stripe_of(bucket);
+        std::lock_guard<std::mutex> guard(stripe.mutex);
+        auto [it, inserted] = buckets[bucket].try_emplace(key, Entry{entry_hash, timestamp});
+        if (inserted) {
+            num_keys++;
+        } else {
+            xor_into(leaves[bucket], it->second.hash);
+            it->second = {entry_hash, timestamp};
+        }
+        xor_into(leaves[bucket], entry_hash);
+        mark_dirty(stripe, bucket);
+    }
+
+    void remove(const std::string& key) override {
+        size_t bucket = bucket_of(key);
+        Stripe& stripe = stripe_of(bucket);
+        std::lock_guard<std::mutex> guard(stripe.mutex);
+        auto it = buckets[bucket].find(key);
+        if (it == buckets[bucket].end()) {
+            return;
+        }
+        xor_into(leaves[bucket], it->second.hash);
+        buckets[bucket].erase(it);
+        num_keys--;
+        mark_dirty(stripe, bucket);
+    }
+
     merkle::Hash get_root_hash() const override {
-        std::lock_guard<std::mutex> guard(tree_mutex);
-        return merkle_tree.empty() ? merkle::Hash() : const_cast<merkle::Tree&>(merkle_tree).root();
+        std::lock_guard<std::mutex> guard(levels_mutex);
+        refresh();
+        return levels.back()[0];
     }
-    
+
+    // A key differs when the peer's bucket leaf on its path differs from ours
     std::vector<std::string> find_differences(
         const std::vector<merkle::Path>& remote_paths,
         const std::vector<std::string>& keys) {
-        std::lock_guard<std::mutex> guard(tree_mutex);
+        std::lock_guard<std::mutex> guard(levels_mutex);
+        refresh();
         std::vector<std::string> differing_keys;
-        
-        if (!merkle_tree.empty()) {
-            auto local_root = merkle_tree.root();
-            for (size_t i = 0; i < remote_paths.size() && i < keys.size(); i++) {
-                if (!remote_paths[i].verify(local_root)) {
-                    differing_keys.push_back(keys[i]);
-                }
+
+        for (size_t i = 0; i < remote_paths.size() && i < keys.size(); i++) {
+            if (remote_paths[i].leaf() != levels[0][bucket_of(keys[i])]) {
+                differing_keys.push_back(keys[i]);
             }
         }
         return differing_keys;
     }
-    
+
+    // One path per requested key: the path of the bucket the key hashes to
     std::vector<merkle::Path> get_paths(const std::vector<std::string>& keys) const override {
-        std::lock_guard<std::mutex> guard(tree_mutex);
+        std::lock_guard<std::mutex> guard(levels_mutex);
+        refresh();
         std::vector<merkle::Path> paths;
-        
-        if (!merkle_tree.empty()) {
-            for (const auto& key : keys) {
-                auto it = key_to_index.find(key);
-                if (it != key_to_index.end()) {
-                    paths.push_back(*const_cast<merkle::Tree&>(merkle_tree).path(it->second));
-                }
-            }
+        paths.reserve(keys.size());
+        for (const auto& key : keys) {
+            paths.push_back(path_for(bucket_of(key)));
         }
         return paths;
     }
-    
+
     size_t size() const override {
-        std::lock_guard<std::mutex> guard(tree_mutex);
-        return merkle_tree.num_leaves();
+        return num_keys;
     }
-    
+
     bool empty() const override {
-        std::lock_guard<std::mutex> guard(tree_mutex);
-        return merkle_tree.empty();
+        return num_keys == 0;
     }
 
+    // Each stripe is read under its own lock, so writes to the others go on meanwhile
     std::unordered_map<std::string, uint64_t> get_key_timestamps() const override {
-        std::lock_guard<std::mutex> guard(tree_mutex);
         std::unordered_map<std::string, uint64_t> result;
-        for (const auto& [key, idx] : key_to_index) {
-            result[key] = 0; // Placeholder, update if you have actual timestamps
+        for (size_t i = 0; i < stripe_count(); i++) {
+            std::lock_guard<std::mutex> guard(stripes[i].mutex);
+            size_t first = i << stripe_shift;
+            for (size_t bucket = first; bucket < first + (size_t(1) << stripe_shift); bucket++) {
+                for (const auto& [key, entry] : buckets[bucket]) {
+                    result[key] = entry.timestamp;
+                }
+            }
         }
         return result;
     }
 
+    size_t depth() const override {
+        return tree_depth;
+    }
+
+    std::vector<merkle::Hash> get_subtree_hashes(size_t level, const std::vector<size_t>& nodes,
+                                                 size_t span) const override {
+        std::vector<merkle::Hash> result;
+        if (level + span > tree_depth) {
+            return result;
+        }
+        std::lock_guard<std::mutex> guard(levels_mutex);
+        refresh();
+        // levels[] is stored leaves-first
+        const auto& below = levels[tree_depth - level - span];
+        size_t width = size_t(1) << span;
+        for (size_t node : nodes) {
+            if ((node + 1) * width > below.size()) continue;
+            result.insert(result.end(), below.begin() + node * width, below.begin() + (node + 1) * width);
+        }
+        return result;
+    }
+
+    std::vector<BucketEntry> get_bucket_entries(const std::vector<size_t>& indices) const override {
+        std::vector<BucketEntry> result;
+        for (size_t bucket : indices) {
+            if (bucket >= buckets.size()) continue;
+            std::lock_guard<std::mutex> guard(stripe_of(bucket).mutex);
+            for (const auto& [key, entry] : buckets[bucket]) {
+                result.push_back({key, entry.timestamp, digest_of(entry.hash)});
+            }
+        }
+        return result;
+    }
+
+    size_t bucket_count() const {
+        return size_t(1) << tree_depth;
+    }
+
+    // Bucket = top depth bits of the key's 64-bit hash, so each bucket covers a contiguous
+    // key-hash range. FNV-1a is used because it is identical on every platform; its high
+    // bits barely depend on the last bytes, so a murmur3 finalizer spreads them.
+    size_t bucket_of(const std::string& key) const {
+        return tree_depth == 0 ? 0 : static_cast<size_t>(key_hash(key) >> (64 - tree_depth));
+    }
+
+    static uint64_t key_hash(std::string_view key) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : key) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
 private:
-    static merkle::Hash hash_key_value(const std::string& key, 
-                                      const std::string& value,
-                                      uint64_t timestamp) {
+    struct Entry {
+        merkle::Hash hash;
+        uint64_t timestamp;
+    };
+
+    // A contiguous range of buckets: their entries, leaf hashes and dirty marks
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+        std::vector<size_t> dirty;  // Buckets changed since the levels were last refreshed
+    };
+
+    size_t stripe_count() const {
+        return bucket_count() >> stripe_shift;
+    }
+
+    Stripe& stripe_of(size_t bucket) const {
+        return stripes[bucket >> stripe_shift];
+    }
+
+    // Called with the bucket's stripe locked
+    void mark_dirty(Stripe& stripe, size_t bucket) {
+        if (!dirty[bucket]) {
+            dirty[bucket] = 1;
+            stripe.dirty.push_back(bucket);
+        }
+    }
+
+    // Called with every lock held
+    void clear_tree() {
+        buckets.assign(bucket_count(), {});
+        leaves.assign(bucket_count(), merkle::Hash());
+        dirty.assign(bucket_count(), 0);
+        for (size_t i = 0; i < stripe_count(); i++) {
+            stripes[i].dirty.clear();
+        }
+        levels.clear();
+        for (size_t width = bucket_count(); ; width /= 2) {
+            levels.emplace_back(width);
+            if (width == 1) break;
+        }
+        num_keys = 0;
+    }
+
+    // Brings the levels up to date with every write that has returned. Each stripe is
+    // locked only while its changed leaves are copied out; the rehash runs under
+    // levels_mutex alone, one node per changed parent, level by level. Called with
+    // levels_mutex held.
+    void refresh() const {
+        std::vector<size_t> changed;
+        for (size_t i = 0; i < stripe_count(); i++) {
+            Stripe& stripe = stripes[i];
+            std::lock_guard<std::mutex> guard(stripe.mutex);
+            for (size_t bucket : stripe.dirty) {
+                levels[0][bucket] = leaves[bucket];
+                dirty[bucket] = 0;
+                changed.push_back(bucket);
+            }
+            stripe.dirty.clear();
+        }
+        std::sort(changed.begin(), changed.end());
+        for (size_t level = 1; level < levels.size() && !changed.empty(); level++) {
+            size_t parents = 0;
+            for (size_t index : changed) {
+                if (parents == 0 || changed[parents - 1] != index / 2) {
+                    changed[parents++] = index / 2;
+                }
+            }
+            changed.resize(parents);
+            const auto& below = levels[level - 1];
+            for (size_t index : changed) {
+                combine(below[2 * index], below[2 * index + 1], levels[level][index]);
+            }
+        }
+    }
+
+    static bool is_zero(const merkle::Hash& hash) {
+        static const merkle::Hash zero;
+        return hash == zero;
+    }
+
+    // Empty subtrees hash to zero, so an empty index has the all-zero root
+    static void combine(const merkle::Hash& left, const merkle::Hash& right, merkle::Hash& out) {
+        if (is_zero(left) && is_zero(right)) {
+            out = merkle::Hash();
+        } else {
+            merkle::sha256_compress(left, right, out);
+        }
+    }
+
+    // First eight bytes of an entry hash, read big-endian so every platform agrees
+    static uint64_t digest_of(const merkle::Hash& hash) {
+        uint64_t digest = 0;
+        for (size_t i = 0; i < 8; i++) {
+            digest = (digest << 8) | hash.bytes[i];
+        }
+        return digest;
+    }
+
+    static void xor_into(merkle::Hash& target, const merkle::Hash& value) {
+        for (size_t i = 0; i < sizeof(target.bytes); i++) {
+            target.bytes[i] ^= value.bytes[i];
+        }
+    }
+
+    merkle::Path path_for(size_t index) const {
+        std::list<merkle::Path::Element> elements;
+        size_t leaf_index = index;
+        for (size_t level = 0; level + 1 < levels.size(); level++) {
+            merkle::Path::Element element;
+            element.hash = levels[level][index ^ 1];
+            element.direction = (index & 1) ? merkle::Path::PATH_LEFT : merkle::Path::PATH_RIGHT;
+            elements.push_back(element);
+            index /= 2;
+        }
+        return merkle::Path(levels[0][leaf_index], leaf_index, std::move(elements), bucket_count() - 1);
+    }
+
+    // Hashes the whole length-prefixed encoding of the entry, 32 bytes at a time. The
+    // expiry time and tombstone marker are appended only when set, so a plain entry
+    // hashes as it always has.
+    static merkle::Hash hash_key_value(const std::string& key,
+                                      std::string_view value,
+                                      uint64_t timestamp,
+                                      uint64_t expire_at,
+                                      bool tombstone) {
         std::ostringstream oss;
-        oss << key << ":" << value << ":" << timestamp;
+        oss << key.size() << ":" << key << ":" << value.size() << ":" << value << ":" << timestamp;
+        if (expire_at) oss << ":x" << expire_at;
+        if (tombstone) oss << ":t";
         std::string combined = oss.str();
-        
-        merkle::Hash left;
-        size_t copy_size = std::min(combined.size(), (size_t)32);
-        std::memcpy(left.bytes, combined.c_str(), copy_size);
-        
-        merkle::Hash right; // Empty hash
+
         merkle::Hash result;
-        merkle::sha256_compress(left, right, result);
+        for (size_t offset = 0; offset < combined.size(); offset += 32) {
+            merkle::Hash block;
+            size_t copy_size = std::min(combined.size() - offset, (size_t)32);
+            std::memcpy(block.bytes, combined.data() + offset, copy_size);
+            merkle::sha256_compress(result, block, result);
+        }
         return result;
     }
 
-    mutable std::mutex tree_mutex;
-    merkle::Tree merkle_tree;
-    std::unordered_map<std::string, size_t> key_to_index;
+    size_t tree_depth;
+    size_t stripe_shift;  // bucket >> stripe_shift is the bucket's stripe
+    std::unique_ptr<Stripe[]> stripes;
+    // Guarded by each bucket's stripe lock
+    std::vector<std::unordered_map<std::string, Entry>> buckets;
+    std::vector<merkle::Hash> leaves;
+    mutable std::vector<uint8_t> dirty;
+    std::atomic<size_t> num_keys{0};
+    // Guarded by levels_mutex; levels[0]: bucket hashes as of the last refresh, levels.back(): root
+    mutable std::mutex levels_mutex;
+    mutable std::vector<std::vector<merkle::Hash>> levels;
 };
 
 #endif // MERKLE_TREE_INDEX_HPP
@@ -0,0 +1,80 @@
+// Microbenchmark: ns per text command for the istringstream tokenizer that
+// Node::process_command used before, against the in-place text_protocol parser.
+//
+// Usage: parse_bench [iterations] [value_size]
+#include "protocol/text_parser.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The previous parse: one istringstream and four string tokens per command
+size_t legacy_parse(const std::string& command) {
+    std::istringstream iss(command);
+    std::string first, timestamp, action, key, value;
+    iss >> first;
+
+    bool is_propagated = false;
+    if (first == "PROPAGATE") {
+        is_propagated = true;
+        iss >> timestamp >> action >> key >> value;
+    } else {
+        action = first;
+        iss >> key >> value;
+    }
+
+    size_t command_id = 0;
+    if (action == "GET") command_id = 1;
+    else if (action == "SET") command_id = 2;
+    else if (action == "DEL") command_id = 3;
+    else if (action == "GET_ALL") command_id = 4;
+    return command_id + key.size() + value.size() + is_propagated;
+}
+
+size_t view_parse(std::string_view command) {
+    auto request = text_protocol::parse(command);
+    return static_cast<size_t>(request.command) + request.key.size() + request.value.size() + request.propagated;
+}
+
+template <typename Parse>
+double ns_per_command(const std::vector<std::string>& commands, size_t iterations, Parse parse, size_t& sink) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        sink += parse(commands[i % commands.size()]);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 5000000;
+    size_t value_size = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 16;
+
+    // A mix of small reads and writes, as seen from clients and peers
+    std::vector<std::string> commands;
+    for (int i = 0; i < 64; i++) {
+        std::string key = "user:" + std::to_string(i * 7919);
+        std::string value(value_size, static_cast<char>('a' + i % 26));
+        commands.push_back("GET " + key);
+        commands.push_back("SET " + key + " " + value);
+        commands.push_back("PROPAGATE 1717171717171717171 SET " + key + " " + value);
+        if (i % 8 == 0) commands.push_back("DEL " + key);
+    }
+
+    size_t sink = 0;
+    double legacy = ns_per_command(commands, iterations, legacy_parse, sink);
+    double view = ns_per_command(commands, iterations, [](const std::string& c) { return view_parse(c); }, sink);
+
+    std::cout << "value size " << value_size << " bytes, " << iterations << " commands\n"
+              << "  istringstream parse: " << legacy << " ns/command\n"
+              << "  string_view parse:   " << view << " ns/command\n"
+              << "  speedup:             " << legacy / view << "x\n"
+              << "(checksum " << sink << ")\n";
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "cluster_config.hpp"
+#include "protocol/text_parser.hpp"
+#include "storage/eviction.hpp"
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Ports are held as short throughout the node
+constexpr uint64_t max_port = std::numeric_limits<short>::max();
+
+std::string_view trim(std::string_view text) {
+    text = text_protocol::skip_space(text);
+    while (!text.empty() && text_protocol::is_space(text.back())) text.remove_suffix(1);
+    return text;
+}
+
+// More tokens than this per node only slow ring rebuilds down
+constexpr uint64_t max_vnodes = 4096;
+
+bool parse_ms(std::string_view text, std::chrono::milliseconds& out) {
+    uint64_t ms;
+    if (!text_protocol::parse_uint(text, ms) || ms == 0) return false;
+    out = std::chrono::milliseconds(ms);
+    return true;
+}
+
+} // namespace
+
+bool ClusterConfig::parse_address(std::string_view text, Address& address) {
+    size_t colon = text.rfind(':');
+    uint64_t port;
+    if (colon == std::string_view::npos || colon == 0 || !text_protocol::parse_uint(text.substr(colon + 1), port) ||
+        port == 0 || port > max_port) {
+        return false;
+    }
+    address.host = std::string(text.substr(0, colon));
+    address.port = static_cast<short>(port);
+    return true;
+}
+
+ClusterConfig ClusterConfig::parse(std::string_view text) {
+    ClusterConfig config;
+    size_t line_number = 0;
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        line_number++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        size_t equals = line.find('=');
+        std::string_view name = trim(line.substr(0, equals));
+        std::string_view value = equals == std::string_view::npos ? std::string_view() : trim(line.substr(equals + 1));
+        uint64_t number = 0;
+        bool ok = true;
+        if (equals == std::string_view::npos) {
+            ok = false;
+        } else if (name == "node_id") {
+            ok = text_protocol::parse_uint(value, number) && number <= 255;
+            config.node_id = static_cast<uint8_t>(number);
+        } else if (name == "host") {
+            ok = !value.empty();
+            config.self.host = std::string(value);
+        } else if (name == "port") {
+            ok = text_protocol::parse_uint(value, number) && number > 0 && number <= max_port;
+            config.self.port = static_cast<short>(number);
+        } else if (name == "data_dir") {
+            config.data_dir = std::string(value);
+        } else if (name == "snapshot_interval_ms") {
+            ok = parse_ms(value, config.snapshot_interval);
+        } else if (name == "seeds") {
+            // Separated by commas and/or whitespace
+            std::string list(value);
+            for (char& c : list) if (c == ',') c = ' ';
+            std::string_view rest(list);
+            for (auto token = text_protocol::next_token(rest); ok && !token.empty(); token = text_protocol::next_token(rest)) {
+                Address seed;
+                ok = parse_address(token, seed);
+                config.seeds.push_back(std::move(seed));
+            }
+        } else if (name == "vnodes") {
+            ok = text_protocol::parse_uint(value, number) && number > 0 && number <= max_vnodes;
+            config.vnodes = static_cast<size_t>(number);
+        } else if (name == "replication_factor") {
+            ok = text_protocol::parse_uint(value, number) && number > 0 && number <= 255;
+            config.replication_factor = static_cast<size_t>(number);
+        } else if (name == "transfer_rate") {
+            ok = eviction::parse_max_memory(value, config.transfer_rate);
+        } else if (name == "gossip_interval_ms") {
+            ok = parse_ms(value, config.gossip_interval);
+        } else if (name == "suspect_after_ms") {
+            ok = parse_ms(value, config.suspect_after);
+        } else if (name == "dead_after_ms") {
+            ok = parse_ms(value, config.dead_after);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            throw std::runtime_error("cluster config line " + std::to_string(line_number) + ": invalid entry '" +
+                                     std::string(line) + "'");
+        }
+    }
+    if (config.self.port == 0) {
+        throw std::runtime_error("cluster config: port is required");
+    }
+    if (config.self.host.empty()) {
+        config.self.host = "127.0.0.1";
+    }
+    if (config.dead_after <= config.suspect_after) {
+        throw std::runtime_error("cluster config: dead_after_ms must exceed suspect_after_ms");
+    }
+    return config;
+}
+
+ClusterConfig ClusterConfig::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("cannot open cluster config " + path);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return parse(contents.str());
+}
@@ -0,0 +1,59 @@
+#ifndef CLUSTER_CONFIG_HPP
+#define CLUSTER_CONFIG_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A node's place in the cluster: who it is and where to find the others. Loaded from a
+// file of "key = value" lines; '#' starts a comment:
+//
+//   node_id = 1                        # 0..255, unique in the cluster
+//   host = 127.0.0.1                   # address the other nodes reach this one at
+//   port = 5008
+//   data_dir = node1_data              # optional; without it nothing is persisted
+//   snapshot_interval_ms = 300000      # optional; how often data_dir gets a snapshot
+//   seeds = 127.0.0.1:5009, 127.0.0.1:5010
+//   vnodes = 64                        # optional partitioning (see HashRing)
+//   replication_factor = 3
+//   transfer_rate = 16m                # bytes/s of a partition transfer; 0 for no limit
+//   gossip_interval_ms = 1000          # optional failure detector timing
+//   suspect_after_ms = 5000
+//   dead_after_ms = 15000
+//
+// Seeds only bootstrap membership. A node learns the rest of the cluster by gossip, so
+// it needs one reachable seed, not a list of every member. The node id is also the node
+// field of the write timestamps it issues (see HybridClock). Every node of a cluster
+// must use the same vnodes and replication_factor, or they disagree on who owns what.
+struct ClusterConfig {
+    struct Address {
+        std::string host;
+        short port = 0;
+
+        std::string to_string() const { return host + ':' + std::to_string(port); }
+        bool operator==(const Address& other) const { return port == other.port && host == other.host; }
+    };
+
+    uint8_t node_id = 0;
+    Address self;
+    std::string data_dir;
+    std::chrono::milliseconds snapshot_interval{300000};
+    std::vector<Address> seeds;
+    size_t vnodes = 64;
+    size_t replication_factor = 3;
+    size_t transfer_rate = size_t(16) << 20;
+    std::chrono::milliseconds gossip_interval{1000};
+    std::chrono::milliseconds suspect_after{5000};
+    std::chrono::milliseconds dead_after{15000};
+
+    // Throw std::runtime_error naming the first bad line
+    static ClusterConfig load(const std::string& path);
+    static ClusterConfig parse(std::string_view text);
+
+    // "host:port"
+    static bool parse_address(std::string_view text, Address& address);
+};
+
+#endif // CLUSTER_CONFIG_HPP
@@ -0,0 +1,40 @@
+#include "hash_ring.hpp"
+#include <algorithm>
+#include <utility>
+
+HashRing::HashRing(std::vector<Address> nodes, size_t vnodes, size_t replication_factor)
+    : nodes_(std::move(nodes)), owners_(partitions) {
+    // Tokens are hashed from addresses, never from the order nodes were listed in
+    std::vector<std::pair<uint64_t, size_t>> tokens;
+    tokens.reserve(nodes_.size() * vnodes);
+    for (size_t node = 0; node < nodes_.size(); node++) {
+        std::string name = nodes_[node].to_string() + '#';
+        for (size_t i = 0; i < vnodes; i++) {
+            tokens.emplace_back(MerkleTreeIndex::key_hash(name + std::to_string(i)), node);
+        }
+    }
+    std::sort(tokens.begin(), tokens.end(), [this](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first < b.first : nodes_[a.second].to_string() < nodes_[b.second].to_string();
+    });
+
+    size_t wanted = std::min(replication_factor, nodes_.size());
+    for (size_t partition = 0; partition < partitions && !tokens.empty(); partition++) {
+        uint64_t start = uint64_t(partition) << (64 - partition_bits);
+        auto first = std::lower_bound(tokens.begin(), tokens.end(), start,
+                                      [](const auto& token, uint64_t position) { return token.first < position; });
+        size_t at = static_cast<size_t>(first - tokens.begin());
+        std::vector<bool> taken(nodes_.size());
+        for (size_t step = 0; step < tokens.size() && owners_[partition].size() < wanted; step++) {
+            size_t node = tokens[(at + step) % tokens.size()].second;
+            if (!taken[node]) {
+                taken[node] = true;
+                owners_[partition].push_back(nodes_[node]);
+            }
+        }
+    }
+}
+
+bool HashRing::owns(const Address& node, size_t partition) const {
+    const auto& owners = owners_[partition];
+    return std::find(owners.begin(), owners.end(), node) != owners.end();
+}
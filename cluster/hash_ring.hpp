@@ -0,0 +1,50 @@
+#ifndef HASH_RING_HPP
+#define HASH_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "cluster_config.hpp"
+#include "anti_entropy/merkle_tree_index.hpp"
+
+// Consistent-hash ring that decides which nodes hold which keys.
+//
+// The 64-bit key-hash space is cut into a fixed number of equal partitions, and a key's
+// partition is the top partition_bits of the same hash that picks its Merkle bucket. A
+// partition is therefore exactly one subtree of the Merkle index, whose hash replicas
+// compare range by range without any index of their own.
+//
+// Every node puts vnodes tokens on the ring, hashed from its address. A partition
+// belongs to the nodes of the first replication_factor distinct tokens at or after its
+// start, going clockwise; the first of them is its primary. When a node joins or
+// leaves, only the partitions next to its tokens change hands, and with many tokens
+// per node they are spread evenly over the others.
+//
+// Immutable: a new ring is built whenever membership changes. Every node builds the
+// same ring from the same members.
+class HashRing {
+public:
+    using Address = ClusterConfig::Address;
+
+    static constexpr size_t partition_bits = 8;
+    static constexpr size_t partitions = size_t(1) << partition_bits;
+
+    HashRing(std::vector<Address> nodes, size_t vnodes, size_t replication_factor);
+
+    static size_t partition_of(std::string_view key) {
+        return static_cast<size_t>(MerkleTreeIndex::key_hash(key) >> (64 - partition_bits));
+    }
+
+    // Primary first; fewer than replication_factor if the ring has fewer nodes
+    const std::vector<Address>& owners(size_t partition) const { return owners_[partition]; }
+    bool owns(const Address& node, size_t partition) const;
+
+    const std::vector<Address>& nodes() const { return nodes_; }
+
+private:
+    std::vector<Address> nodes_;
+    std::vector<std::vector<Address>> owners_;  // Per partition
+};
+
+#endif // HASH_RING_HPP
@@ -0,0 +1,248 @@
+#include "membership.hpp"
+#include "protocol/binary_protocol.hpp"
+#include "storage/hybrid_clock.hpp"
+#include "logging/logger.hpp"
+#include <array>
+#include <boost/asio.hpp>
+#include <cstring>
+
+namespace {
+
+// A reply larger than this is not a member table
+constexpr size_t max_table_size = 1024 * 1024;
+
+} // namespace
+
+Membership::Membership(const ClusterConfig& config)
+    : config_(config), self_key_(config.self.to_string()), random_(std::random_device{}()) {
+    Entry self;
+    self.member.node_id = config_.node_id;
+    self.member.address = config_.self;
+    self.member.heartbeat = HybridClock::wall_clock_ms();
+    self.updated = std::chrono::steady_clock::now();
+    table_.emplace(self_key_, std::move(self));
+}
+
+Membership::~Membership() {
+    stop();
+}
+
+void Membership::start() {
+    stopping_ = false;
+    gossip_thread_ = std::thread([this]() { run(); });
+}
+
+void Membership::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (gossip_thread_.joinable()) {
+        gossip_thread_.join();
+    }
+}
+
+const char* Membership::state_name(State state) {
+    switch (state) {
+        case State::ALIVE: return "alive";
+        case State::SUSPECT: return "suspect";
+        case State::DEAD: return "dead";
+    }
+    return "unknown";
+}
+
+std::vector<Membership::Member> Membership::members() const {
+    std::lock_guard<std::mutex> lock(table_mutex_);
+    std::vector<Member> out;
+    for (const auto& [key, entry] : table_) {
+        if (key != self_key_) out.push_back(entry.member);
+    }
+    return out;
+}
+
+std::vector<Membership::Member> Membership::live_members() const {
+    std::lock_guard<std::mutex> lock(table_mutex_);
+    std::vector<Member> out;
+    for (const auto& [key, entry] : table_) {
+        if (key != self_key_ && entry.member.state != State::DEAD) out.push_back(entry.member);
+    }
+    return out;
+}
+
+std::string Membership::handle_gossip(std::string_view payload) {
+    std::lock_guard<std::mutex> lock(table_mutex_);
+    notify(merge_table(payload));
+    return encode_table();
+}
+
+void Membership::run() {
+    // The first round goes out at once, so a starting node joins without waiting
+    std::unique_lock<std::mutex> lock(mutex_);
+    do {
+        lock.unlock();
+        try {
+            gossip_round();
+        } catch (const std::exception& e) {
+            KV_LOG_WARN("Gossip error: " << e.what());
+        }
+        lock.lock();
+    } while (!cv_.wait_for(lock, config_.gossip_interval, [this]() { return stopping_; }));
+}
+
+void Membership::gossip_round() {
+    std::vector<ClusterConfig::Address> targets;
+    {
+        std::lock_guard<std::mutex> lock(table_mutex_);
+        Member& self = table_.at(self_key_).member;
+        self.heartbeat = std::max(self.heartbeat + 1, HybridClock::wall_clock_ms());
+        notify(update_states());
+
+        std::vector<ClusterConfig::Address> live;
+        std::vector<ClusterConfig::Address> fallback;
+        for (const auto& [key, entry] : table_) {
+            if (key == self_key_) continue;
+            (entry.member.state == State::DEAD ? fallback : live).push_back(entry.member.address);
+        }
+        for (const auto& seed : config_.seeds) {
+            if (!(seed == config_.self) && !table_.count(seed.to_string())) fallback.push_back(seed);
+        }
+        auto pick = [this](const std::vector<ClusterConfig::Address>& from) {
+            return from[std::uniform_int_distribution<size_t>(0, from.size() - 1)(random_)];
+        };
+        if (!live.empty()) {
+            targets.push_back(pick(live));
+        } else if (!fallback.empty()) {
+            targets.push_back(pick(fallback));
+        }
+        if (++rounds_ % revive_every == 0 && !live.empty() && !fallback.empty()) {
+            targets.push_back(pick(fallback));
+        }
+    }
+
+    for (const auto& target : targets) {
+        if (!exchange(target)) {
+            KV_LOG_DEBUG("Gossip with " << target.to_string() << " got no reply");
+        }
+    }
+}
+
+bool Membership::exchange(const ClusterConfig::Address& address) {
+    using boost::asio::ip::tcp;
+    std::string request = std::string(binary_protocol::kHandshake) + "\n";
+    {
+        std::lock_guard<std::mutex> lock(table_mutex_);
+        binary_protocol::encode_request(request, binary_protocol::OP_GOSSIP, "", encode_table());
+    }
+
+    // The handshake and the request go out together; the reply is "OK\n" and one frame.
+    // Everything runs on a private io_context, so a member that does not answer costs at
+    // most one gossip interval.
+    boost::asio::io_context io_context;
+    tcp::resolver resolver(io_context);
+    boost::system::error_code error;
+    auto endpoints = resolver.resolve(address.host, std::to_string(address.port), error);
+    if (error) {
+        return false;
+    }
+    tcp::socket socket(io_context);
+    std::array<char, 3 + binary_protocol::kResponseHeaderSize> header;
+    std::string reply;
+    bool done = false;
+    boost::asio::async_connect(socket, endpoints, [&](boost::system::error_code ec, const tcp::endpoint&) {
+        if (ec) return;
+        boost::asio::async_write(socket, boost::asio::buffer(request), [&](boost::system::error_code ec, size_t) {
+            if (ec) return;
+            boost::asio::async_read(socket, boost::asio::buffer(header), [&](boost::system::error_code ec, size_t) {
+                if (ec || std::memcmp(header.data(), "OK\n", 3) != 0 || header[3] != binary_protocol::STATUS_OK) return;
+                size_t length = binary_protocol::load_u32(header.data() + 3 + 4);
+                if (length > max_table_size) return;
+                reply.resize(length);
+                boost::asio::async_read(socket, boost::asio::buffer(reply), [&](boost::system::error_code ec, size_t) {
+                    done = !ec;
+                });
+            });
+        });
+    });
+    io_context.run_for(config_.gossip_interval);
+    if (!done) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(table_mutex_);
+    notify(merge_table(reply));
+    return true;
+}
+
+std::string Membership::encode_table() const {
+    std::string out;
+    for (const auto& [key, entry] : table_) {
+        const Member& member = entry.member;
+        binary_protocol::append_member(out, member.node_id, member.address.host,
+                                       static_cast<uint16_t>(member.address.port), member.heartbeat);
+    }
+    return out;
+}
+
+std::vector<Membership::Member> Membership::merge_table(std::string_view payload) {
+    std::vector<Member> changed;
+    auto now = std::chrono::steady_clock::now();
+    bool valid = binary_protocol::for_each_member(payload, [&](uint8_t node_id, std::string_view host, uint16_t port,
+                                                               uint64_t heartbeat) {
+        ClusterConfig::Address address{std::string(host), static_cast<short>(port)};
+        std::string key = address.to_string();
+        auto it = table_.find(key);
+        if (key == self_key_) {
+            // Others remember a heartbeat from before a restart with the clock set back
+            Member& self = it->second.member;
+            if (heartbeat > self.heartbeat) self.heartbeat = heartbeat + 1;
+            return;
+        }
+        if (it == table_.end()) {
+            Entry entry{Member{node_id, std::move(address), heartbeat, State::ALIVE}, now};
+            KV_LOG_INFO("Member " << key << " (node " << int(node_id) << ") joined");
+            changed.push_back(entry.member);
+            table_.emplace(std::move(key), std::move(entry));
+            return;
+        }
+        Member& member = it->second.member;
+        if (heartbeat <= member.heartbeat) return;
+        member.heartbeat = heartbeat;
+        member.node_id = node_id;
+        it->second.updated = now;
+        if (member.state != State::ALIVE) {
+            KV_LOG_INFO("Member " << key << " is " << state_name(member.state) << " -> alive");
+            member.state = State::ALIVE;
+            changed.push_back(member);
+        }
+    });
+    if (!valid) {
+        KV_LOG_WARN("Malformed gossip table");
+    }
+    return changed;
+}
+
+std::vector<Membership::Member> Membership::update_states() {
+    std::vector<Member> changed;
+    auto now = std::chrono::steady_clock::now();
+    for (auto& [key, entry] : table_) {
+        if (key == self_key_) continue;
+        auto age = now - entry.updated;
+        State state = age >= config_.dead_after ? State::DEAD
+                    : age >= config_.suspect_after ? State::SUSPECT
+                    : State::ALIVE;
+        if (state != entry.member.state) {
+            KV_LOG_INFO("Member " << key << " is " << state_name(entry.member.state) << " -> " << state_name(state));
+            entry.member.state = state;
+            changed.push_back(entry.member);
+        }
+    }
+    return changed;
+}
+
+void Membership::notify(const std::vector<Member>& changed) {
+    if (!listener_) return;
+    for (const auto& member : changed) {
+        listener_(member);
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef MEMBERSHIP_HPP
+#define MEMBERSHIP_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "cluster_config.hpp"
+
+// Cluster membership by gossip, with a heartbeat failure detector.
+//
+// Every node keeps a table of the members it knows: address, node id and heartbeat. Once
+// per gossip interval it raises its own heartbeat and swaps tables with one other member
+// picked at random (push-pull, over the binary protocol's GOSSIP request). Both sides keep
+// the higher heartbeat per address and note when each last rose. News of a node reaches
+// the whole cluster in O(log N) rounds, and no node has to hear from every other directly.
+//
+// A member whose heartbeat has not risen for suspect_after is SUSPECT, for dead_after
+// DEAD. States are each node's own judgement and are not gossiped. Replication and
+// anti-entropy leave dead members out, and a heartbeat that rises again brings a member
+// back. Heartbeats are wall-clock ms rather than counters, so a node that restarts
+// carries on above the heartbeat the others remember.
+//
+// A node that knows no live member gossips with its seeds, and every few rounds it also
+// tries a dead member or a seed, so a partition heals once the network does.
+class Membership {
+public:
+    enum class State : uint8_t {
+        ALIVE,
+        SUSPECT,
+        DEAD
+    };
+
+    struct Member {
+        uint8_t node_id = 0;
+        ClusterConfig::Address address;
+        uint64_t heartbeat = 0;
+        State state = State::ALIVE;
+    };
+
+    // Called with a member that joined or changed state, from the gossip thread or a
+    // session serving a GOSSIP request. Calls come one at a time and in the order the
+    // changes happened, under the table lock, so a listener must not call back in.
+    using Listener = std::function<void(const Member&)>;
+
+    // Every this many rounds a dead member or a seed is tried as well
+    static constexpr uint64_t revive_every = 5;
+
+    explicit Membership(const ClusterConfig& config);
+    ~Membership();
+
+    // Set before start
+    void set_listener(Listener listener) { listener_ = std::move(listener); }
+
+    void start();
+    void stop();
+
+    // Serves a GOSSIP request: merges the sender's table and returns this node's
+    std::string handle_gossip(std::string_view payload);
+
+    // Every other member, whatever its state
+    std::vector<Member> members() const;
+    // Other members that are not dead
+    std::vector<Member> live_members() const;
+
+    const ClusterConfig& config() const { return config_; }
+
+    static const char* state_name(State state);
+
+private:
+    struct Entry {
+        Member member;
+        std::chrono::steady_clock::time_point updated;  // When the heartbeat last rose
+    };
+
+    void run();
+    void gossip_round();
+    // Swaps tables with the member at address; false if it did not answer in time
+    bool exchange(const ClusterConfig::Address& address);
+
+    // Called with table_mutex_ held. The merge and state updates return the members that
+    // are new or changed state, for notify to pass to the listener.
+    std::string encode_table() const;
+    std::vector<Member> merge_table(std::string_view payload);
+    std::vector<Member> update_states();
+    void notify(const std::vector<Member>& changed);
+
+    ClusterConfig config_;
+    std::string self_key_;
+    Listener listener_;
+
+    mutable std::mutex table_mutex_;
+    std::unordered_map<std::string, Entry> table_;  // By address, this node included
+    uint64_t rounds_ = 0;
+    std::mt19937 random_;  // Gossip thread only
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::thread gossip_thread_;
+};
+
+#endif // MEMBERSHIP_HPP
@@ -0,0 +1,56 @@
+#include "io_context_pool.hpp"
+
+IoContextPool::IoContextPool(size_t threads, Mode mode)
+    : mode_(mode), thread_count_(threads == 0 ? 1 : threads) {
+#ifndef SO_REUSEPORT
+    mode_ = SHARED;
+#endif
+    if (mode_ == SHARED) {
+        contexts_.push_back(std::make_unique<boost::asio::io_context>(static_cast<int>(thread_count_)));
+    } else {
+        // A concurrency hint of 1 lets each context skip its internal locking
+        for (size_t i = 0; i < thread_count_; i++) {
+            contexts_.push_back(std::make_unique<boost::asio::io_context>(1));
+        }
+    }
+    for (auto& context : contexts_) {
+        work_guards_.emplace_back(context->get_executor());
+    }
+}
+
+IoContextPool::~IoContextPool() {
+    stop();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+std::vector<boost::asio::io_context*> IoContextPool::contexts() const {
+    std::vector<boost::asio::io_context*> result;
+    for (const auto& context : contexts_) {
+        result.push_back(context.get());
+    }
+    return result;
+}
+
+void IoContextPool::run() {
+    // Thread i serves context i in PER_CORE mode; every thread serves the one context otherwise
+    for (size_t i = 1; i < thread_count_; i++) {
+        auto& context = *contexts_[mode_ == PER_CORE ? i : 0];
+        threads_.emplace_back([&context]() { context.run(); });
+    }
+    contexts_.front()->run();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+}
+
+void IoContextPool::stop() {
+    work_guards_.clear();
+    for (auto& context : contexts_) {
+        context->stop();
+    }
+}
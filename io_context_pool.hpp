@@ -0,0 +1,51 @@
+#ifndef IO_CONTEXT_POOL_HPP
+#define IO_CONTEXT_POOL_HPP
+
+#include <boost/asio.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Threads that serve a node's network I/O and command processing.
+//
+// SHARED:   one io_context run by every thread. A single acceptor feeds all of them
+//           and any thread may run any session's next handler.
+// PER_CORE: one io_context per thread, each with its own SO_REUSEPORT acceptor on the
+//           node's port. The kernel spreads incoming connections over the acceptors and
+//           a session stays on the thread that accepted it, so contexts never contend.
+class IoContextPool {
+public:
+    enum Mode {
+        SHARED,
+        PER_CORE
+    };
+
+    // PER_CORE falls back to SHARED on platforms without SO_REUSEPORT
+    explicit IoContextPool(size_t threads, Mode mode = PER_CORE);
+    ~IoContextPool();
+
+    IoContextPool(const IoContextPool&) = delete;
+    IoContextPool& operator=(const IoContextPool&) = delete;
+
+    Mode mode() const { return mode_; }
+    size_t thread_count() const { return thread_count_; }
+
+    // The contexts acceptors are bound to: one in SHARED mode, one per thread in PER_CORE mode
+    std::vector<boost::asio::io_context*> contexts() const;
+    boost::asio::io_context& primary() { return *contexts_.front(); }
+
+    // Runs the pool on the calling thread plus thread_count() - 1 others until stop()
+    void run();
+    void stop();
+
+private:
+    using WorkGuard = boost::asio::executor_work_guard<boost::asio::io_context::executor_type>;
+
+    Mode mode_;
+    size_t thread_count_;
+    std::vector<std::unique_ptr<boost::asio::io_context>> contexts_;
+    std::vector<WorkGuard> work_guards_;
+    std::vector<std::thread> threads_;
+};
+
+#endif // IO_CONTEXT_POOL_HPP
@@ -0,0 +1,45 @@
+#include "node.hpp"
+#include "cluster/cluster_config.hpp"
+#include <boost/asio.hpp>
+#include <algorithm>
+#include "logging/logger.hpp"
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Usage: kv_node <cluster config> [io_threads] [per_core|shared] [maxmemory, e.g. 256m; 0 = no cap] [lru|lfu|random]
+int main(int argc, char* argv[]) {
+    try {
+        if (argc < 2) {
+            throw std::invalid_argument("usage: kv_node <cluster config> [io_threads] [per_core|shared] "
+                                        "[maxmemory] [lru|lfu|random]");
+        }
+        ClusterConfig config = ClusterConfig::load(argv[1]);
+        size_t io_threads = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+        auto mode = argc > 3 && std::string(argv[3]) == "shared" ? IoContextPool::SHARED : IoContextPool::PER_CORE;
+        IoContextPool pool(io_threads, mode);
+        Node node(pool, config);
+        KV_LOG_INFO("Node " << int(config.node_id) << " serving on " << config.self.to_string() << " with "
+                    << config.seeds.size() << " seeds");
+        size_t max_memory = 0;
+        EvictionPolicy policy = EvictionPolicy::LRU;
+        if (argc > 4 && !eviction::parse_max_memory(argv[4], max_memory)) {
+            throw std::invalid_argument(std::string("invalid maxmemory: ") + argv[4]);
+        }
+        if (argc > 5 && !eviction::parse_policy(argv[5], policy)) {
+            throw std::invalid_argument(std::string("invalid eviction policy: ") + argv[5]);
+        }
+        node.set_max_memory(max_memory, policy);
+        if (!config.data_dir.empty()) {
+            PersistenceManager::Options options;
+            options.snapshot_interval = config.snapshot_interval;
+            node.enable_persistence(config.data_dir, options);
+        }
+        node.start_anti_entropy();
+        pool.run();
+    } catch (std::exception& e) {
+        KV_LOG_ERROR("Exception: " << e.what());
+        return 1;
+    }
+    return 0;
+}
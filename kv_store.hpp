@@ -1,14 +1,25 @@
 #ifndef KV_STORE_HPP
 #define KV_STORE_HPP
 
-#include <unordered_map>
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <chrono>
-#include <sstream>
+#include <string_view>
 #include <memory>
+#include <vector>
+#include <functional>
 #include "anti_entropy/index_interface.hpp"
-#include <iostream>
+#include "persistence/write_ahead_log.hpp"
+#include "logging/logger.hpp"
+#include "storage/change_log.hpp"
+#include "storage/eviction.hpp"
+#include "storage/hybrid_clock.hpp"
+#include "storage/shard_map.hpp"
+#include "storage/timing_wheel.hpp"
+#include "value_ref.hpp"
 
 class KeyValueStore {
 public:
@@ -17,110 +28,671 @@ public:
         uint64_t timestamp;
     };
 
-    std::string get(const std::string& key) {
-        std::lock_guard<std::recursive_mutex> lock(mutex_);
-        auto it = store_.find(key);
-        return it != store_.end() ? it->second.value : "";
+    // A stored value as held by the store: sharing it costs a reference count, not a copy.
+    // A deleted key, or one whose TTL has passed, becomes a tombstone: no value, just the
+    // timestamp of the delete (or the expiry time). The tombstone keeps the key in the
+    // Merkle index, so a peer still holding the value learns that it is gone instead of
+    // copying it back, until the tombstone is collected; see gc_horizon.
+    struct StoredValue {
+        ValueRef value;
+        uint64_t timestamp;
+        uint64_t expire_at = 0;  // Wall-clock ms at which the key expires; 0 for never
+        bool tombstone = false;
+    };
+
+    // shard_count independently locked shards, chosen by key hash; 1 gives the single-lock store
+    explicit KeyValueStore(size_t shard_count = 1)
+        : shards_(shard_count == 0 ? 1 : shard_count) {}
+
+    size_t shard_count() const { return shards_.size(); }
+
+    // Issues the timestamps of local writes and follows those of writes from other nodes.
+    // Timestamps are HybridClock values throughout the store; expiry times and the GC
+    // horizon are wall-clock ms.
+    HybridClock& clock() { return clock_; }
+
+    // Records the keys written to ranges that are being transferred to another node
+    ChangeLog& change_log() { return change_log_; }
+
+    // Caps the store at max_memory bytes (0 removes the cap). A write that takes usage
+    // past the cap evicts keys until it is back under: samples entries from one shard at
+    // a time and drops the worst by policy. Eviction is local: an evicted key is neither
+    // logged nor propagated, and it stays in the Merkle index at the version it had, so
+    // anti-entropy does not copy it back from a peer that holds the same version. Only a
+    // newer write to it is pulled in again. A restart replays it before evicting again.
+    // Tombstones are never evicted: dropping one would let a replica that missed the
+    // delete bring the key back.
+    void set_max_memory(size_t max_memory, EvictionPolicy policy = EvictionPolicy::LRU, size_t samples = 5) {
+        eviction_policy_.store(policy, std::memory_order_relaxed);
+        eviction_samples_.store(samples == 0 ? 1 : samples, std::memory_order_relaxed);
+        max_memory_.store(max_memory, std::memory_order_relaxed);
+        evict_to_limit();
+    }
+
+    size_t max_memory() const { return max_memory_.load(std::memory_order_relaxed); }
+
+    // Estimated bytes held by the store's keys and values; see entry_bytes
+    size_t used_memory() const {
+        return static_cast<size_t>(std::max<int64_t>(used_memory_.load(std::memory_order_relaxed), 0));
+    }
+
+    uint64_t evicted_keys() const { return evicted_keys_.load(std::memory_order_relaxed); }
+
+    uint64_t expired_keys() const { return expired_keys_.load(std::memory_order_relaxed); }
+
+    // Tombstones currently held
+    size_t tombstones() const {
+        return static_cast<size_t>(std::max<int64_t>(tombstones_.load(std::memory_order_relaxed), 0));
+    }
+
+    uint64_t collected_tombstones() const { return collected_tombstones_.load(std::memory_order_relaxed); }
+
+    // How long a tombstone is kept at most, in ms. A replica that misses a delete and stays
+    // out of sync for longer than this can bring the key back.
+    void set_tombstone_grace(uint64_t grace_ms) { tombstone_grace_ms_.store(grace_ms, std::memory_order_relaxed); }
+
+    // Tombstones whose timestamp falls at or below this wall-clock ms are collected, and one
+    // this old is not taken in for a key the store does not hold: it has either been seen by every replica (see
+    // advance_gc_horizon) or is older than the grace period.
+    uint64_t gc_horizon() const {
+        uint64_t now = wall_clock_ms();
+        uint64_t grace = tombstone_grace_ms_.load(std::memory_order_relaxed);
+        return std::max(now > grace ? now - grace : 0, replicated_horizon_.load(std::memory_order_relaxed));
+    }
+
+    // Records that every replica holds every tombstone at or below horizon, so they may go
+    // before the grace period is up. Never moves the horizon back.
+    void advance_gc_horizon(uint64_t horizon) {
+        uint64_t current = replicated_horizon_.load(std::memory_order_relaxed);
+        while (current < horizon && !replicated_horizon_.compare_exchange_weak(current, horizon,
+                                                                                std::memory_order_relaxed)) {
+        }
+    }
+
+    std::string get(std::string_view key) {
+        return get_ref(key).value.str();
+    }
+
+    // Allocation-free read: the key is looked up as a view and the value is shared,
+    // not copied. timestamp is 0 if the key is absent, expired or a tombstone. Expiry
+    // is lazy here: a key past its TTL reads as absent before the reaper gets to it.
+    StoredValue get_ref(std::string_view key) const {
+        const Shard& shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        if (const Entry* entry = shard.store.find(key); entry && is_live(entry->stored)) {
+            touch(*entry);
+            return entry->stored;
+        }
+        return {ValueRef(), 0};
+    }
+
+    // The key's version as replicas compare it, tombstones included: a key past its TTL
+    // reads as the tombstone it is about to become. timestamp is 0 if the key is absent.
+    StoredValue get_entry(std::string_view key) const {
+        const Shard& shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        const Entry* entry = shard.store.find(key);
+        if (!entry) {
+            return {ValueRef(), 0};
+        }
+        return is_expired(entry->stored, wall_clock_ms()) ? tombstone_of(entry->stored) : entry->stored;
+    }
+
+    // expire_at is the wall-clock ms at which the key expires, 0 for never. Returns false
+    // if the key holds a newer write, or if timestamp is too far ahead to be taken in
+    // (see HybridClock::too_far_ahead); the write is then not applied.
+    bool set(const std::string& key, const std::string& value, uint64_t timestamp, uint64_t expire_at = 0) {
+        return apply_set(key, value, timestamp, expire_at, false, false);
+    }
+
+    // Applies a write that originated on another replica. Strict last-write-wins: an
+    // equal timestamp goes to the larger value, so every replica keeps the same winner
+    // whatever order the writes arrive in.
+    bool merge(const std::string& key, const std::string& value, uint64_t timestamp, uint64_t expire_at = 0) {
+        return apply_set(key, value, timestamp, expire_at, true, false);
+    }
+
+    // Applies a tombstone from another replica. The key reads as absent until a write
+    // newer than timestamp; a tombstone wins a tie with a value. Unlike del, an absent key
+    // gets the tombstone too, unless it is past the GC horizon.
+    bool merge_tombstone(const std::string& key, uint64_t timestamp) {
+        return apply_tombstone(key, timestamp, true, false);
+    }
+
+    // Loads a write back from the snapshot or the log on startup. It was taken in when it
+    // was made, so it is taken in again however far ahead of the wall clock it now is, as
+    // after the clock was set back across a restart.
+    bool restore(const std::string& key, const std::string& value, uint64_t timestamp, uint64_t expire_at) {
+        return apply_set(key, value, timestamp, expire_at, false, true);
+    }
+
+    bool restore_tombstone(const std::string& key, uint64_t timestamp) {
+        return apply_tombstone(key, timestamp, true, true);
     }
 
-    bool set(const std::string& key, const std::string& value, uint64_t timestamp) {
-        std::lock_guard<std::recursive_mutex> lock(mutex_);
-        auto it = store_.find(key);
-        if (it == store_.end() || timestamp >= it->second.timestamp) {
-            store_[key] = {value, timestamp};
-            if (merkle_index) {
-                merkle_index->rebuild(get_all_key_value_data());
+    // Writes refused for a timestamp too far ahead of the local clock
+    uint64_t rejected_writes() const { return rejected_writes_.load(std::memory_order_relaxed); }
+
+    // Sets a live key's expiry time (EXPIRE). This is a write at timestamp, so it replicates
+    // and resolves like a SET of the current value. An expiry time already past turns the
+    // key into a tombstone at once. Returns the key's new version, or one with timestamp 0
+    // if there is no live key or it holds a newer write.
+    StoredValue expire(const std::string& key, uint64_t expire_at, uint64_t timestamp) {
+        if (!observe(timestamp, false)) {
+            return StoredValue{ValueRef(), 0};
+        }
+        Shard& shard = shard_for(key);
+        uint64_t log_sequence = 0;
+        auto wal = std::atomic_load(&write_ahead_log);
+        ValueRef released;
+        StoredValue updated{ValueRef(), 0};
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            uint64_t now = wall_clock_ms();
+            Entry* entry = shard.store.find(key);
+            if (entry) {
+                settle(shard, key, *entry, now, released);
+            }
+            if (!entry || entry->stored.tombstone || timestamp < entry->stored.timestamp) {
+                return updated;
+            }
+            if (wal) {
+                log_sequence = wal->append(WriteAheadLog::RECORD_SET_TTL, key, entry->stored.value.str(), timestamp, expire_at);
+            }
+            entry->stored.timestamp = timestamp;
+            entry->stored.expire_at = expire_at;
+            updated = entry->stored;
+            if (auto index = std::atomic_load(&merkle_index)) {
+                index->upsert(key, updated.value.view(), timestamp, expire_at, false);
             }
-            return true;
+            change_log_.record(key);
+            schedule_expiry(shard, key, *entry, now, released);
         }
-        return false;
+        if (wal) {
+            wal->wait_durable(log_sequence);
+        }
+        return updated;
     }
 
+    // Active expiry, called periodically by ExpiryReaper: turns every key whose TTL has
+    // passed into a tombstone. Each shard's timing wheel hands over just the keys that
+    // are due, so nothing is scanned. Returns the number of keys expired.
+    size_t expire_due() {
+        size_t expired = 0;
+        for (auto& shard : shards_) {
+            {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                if (shard.expiry.size() == 0) continue;
+            }
+            std::vector<ValueRef> released;  // Freed after the lock is dropped
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            uint64_t now = wall_clock_ms();
+            shard.expiry.advance(now, [&](std::string_view key, uint64_t expire_at) {
+                Entry* entry = shard.store.find(key);
+                // A key rewritten since the timer was set has a timer of its own, if any
+                if (entry && !entry->stored.tombstone && entry->stored.expire_at == expire_at) {
+                    settle(shard, std::string(key), *entry, now, released.emplace_back());
+                    expired++;
+                }
+            });
+        }
+        return expired;
+    }
+
+    // Replaces a live key with a tombstone at timestamp. Returns false if there is no live
+    // key or it holds a newer write.
     bool del(const std::string& key, uint64_t timestamp) {
-        std::lock_guard<std::recursive_mutex> lock(mutex_);
-        auto it = store_.find(key);
-        if (it != store_.end() && timestamp >= it->second.timestamp) {
-            store_.erase(it);
-            if (merkle_index) {
-                merkle_index->rebuild(get_all_key_value_data());
+        return apply_tombstone(key, timestamp, false, false);
+    }
+
+    // Drops the tombstones at or below the GC horizon, called periodically by ExpiryReaper.
+    // Each shard keeps its tombstones on a second timing wheel, ordered by timestamp and
+    // advanced to the horizon, so only collectable tombstones are touched. Collection is
+    // not logged: a restart replays the delete, and the tombstone goes again. Returns the
+    // number collected.
+    size_t collect_tombstones() {
+        size_t collected = 0;
+        uint64_t horizon = gc_horizon();
+        for (auto& shard : shards_) {
+            {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                if (shard.tombstones.size() == 0) continue;
             }
-            return true;
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            shard.tombstones.advance(horizon, [&](std::string_view key, uint64_t) {
+                Entry* entry = shard.store.find(key);
+                // A key written or deleted again since has moved on
+                if (entry && entry->stored.tombstone && HybridClock::physical_ms(entry->stored.timestamp) <= horizon) {
+                    used_memory_.fetch_sub(entry_bytes(key, ValueRef()), std::memory_order_relaxed);
+                    shard.store.erase(key);
+                    if (auto index = std::atomic_load(&merkle_index)) {
+                        index->remove(std::string(key));
+                    }
+                    tombstones_.fetch_sub(1, std::memory_order_relaxed);
+                    collected++;
+                }
+            });
         }
-        return false;
+        collected_tombstones_.fetch_add(collected, std::memory_order_relaxed);
+        return collected;
+    }
+
+    // Removes a key of a range this node no longer owns, once the range's owners hold it.
+    // The key leaves the Merkle index but nothing is logged, so a restart replays it and
+    // it is dropped again. An evicted key is only in the index and leaves it all the same.
+    // Returns false if the store did not hold the key.
+    bool drop(const std::string& key) {
+        Shard& shard = shard_for(key);
+        ValueRef released;  // Freed after the lock is dropped
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        Entry* entry = shard.store.find(key);
+        if (!entry) {
+            if (auto index = std::atomic_load(&merkle_index)) {
+                index->remove(key);
+            }
+            return false;
+        }
+        used_memory_.fetch_sub(entry_bytes(key, entry->stored.value), std::memory_order_relaxed);
+        if (entry->stored.tombstone) {
+            tombstones_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        released = std::move(entry->stored.value);
+        shard.store.erase(key);
+        if (auto index = std::atomic_load(&merkle_index)) {
+            index->remove(key);
+        }
+        return true;
+    }
+
+    // Every applied SET/DEL from now on is appended to the log; attach after replaying it
+    void set_write_ahead_log(std::shared_ptr<WriteAheadLog> wal) {
+        std::atomic_store(&write_ahead_log, wal);
     }
 
     void set_merkle_index(std::shared_ptr<IndexInterface> index) {
-        std::cout << "KeyValueStore::set_merkle_index: entered" << std::endl;
-        std::lock_guard<std::recursive_mutex> lock(mutex_);
-        merkle_index = index;
-        if (merkle_index) {
-            std::cout << "KeyValueStore::set_merkle_index: calling rebuild" << std::endl;
-            merkle_index->rebuild(get_all_key_value_data());
-            std::cout << "KeyValueStore::set_merkle_index: rebuild done" << std::endl;
+        // Attaching an index is the one operation that holds every shard: the rebuild must
+        // see a consistent store, and no delta may slip in between it and the pointer swap.
+        // Shared locks are enough to hold writers off; readers carry on.
+        std::vector<std::shared_lock<std::shared_mutex>> locks;
+        locks.reserve(shards_.size());
+        for (auto& shard : shards_) {
+            locks.emplace_back(shard.mutex);
+        }
+        std::atomic_store(&merkle_index, index);
+        if (index) {
+            IndexInterface::KeyValueData data;
+            for (const auto& shard : shards_) {
+                append_key_value_data(shard, data);
+            }
+            index->rebuild(data);
         }
     }
 
+    // Walks the shards one at a time; writers are only ever blocked on the shard being copied
     IndexInterface::KeyValueData get_all_key_value_data() const {
-        std::cout << "KeyValueStore::get_all_key_value_data: entered" << std::endl;
-        std::lock_guard<std::recursive_mutex> lock(const_cast<std::recursive_mutex&>(mutex_));
         IndexInterface::KeyValueData result;
-        for (const auto& [key, value_ts] : store_) {
-            result[key] = {value_ts.value, value_ts.timestamp};
+        for (const auto& shard : shards_) {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            append_key_value_data(shard, result);
         }
-        std::cout << "KeyValueStore::get_all_key_value_data: returning" << std::endl;
         return result;
     }
 
-    std::string process_command(const std::string& command) {
-        std::istringstream iss(command);
-        std::string action, key, value;
-        iss >> action >> key >> value;
-        
-        if (action == "GET") {
-            return get(key);
-        } else if (action == "SET") {
-            uint64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::system_clock::now().time_since_epoch()
-            ).count();
-            return set(key, value, timestamp) ? "OK" : "ERROR: Outdated timestamp";
-        } else if (action == "DEL") {
-            uint64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::system_clock::now().time_since_epoch()
-            ).count();
-            return del(key, timestamp) ? "OK" : "ERROR: Key not found or outdated timestamp";
-        } else if (action == "GET_ALL") {
-            auto data = get_all_key_value_data();
-            std::string result;
-            for (const auto& [key, value_ts] : data) {
-                result += key + ":" + std::to_string(value_ts.second) + ";";
-            }
-            return result;
-        }
-        return "ERROR: Invalid command";
-    }
-
+    // Live keys only; tombstones and expired keys are left out
     std::vector<std::pair<std::string, uint64_t>> get_all_keys_with_timestamps() const {
-        std::lock_guard<std::recursive_mutex> lock(const_cast<std::recursive_mutex&>(mutex_));
         std::vector<std::pair<std::string, uint64_t>> result;
-        for (const auto& [key, value_ts] : store_) {
-            result.emplace_back(key, value_ts.timestamp);
+        for (size_t index = 0; index < shards_.size(); index++) {
+            auto keys = get_shard_keys_with_timestamps(index);
+            result.insert(result.end(), std::make_move_iterator(keys.begin()), std::make_move_iterator(keys.end()));
         }
         return result;
     }
 
-    ValueWithTimestamp get_value_with_timestamp(const std::string& key) const {
-        std::lock_guard<std::recursive_mutex> lock(const_cast<std::recursive_mutex&>(mutex_));
-        auto it = store_.find(key);
-        if (it != store_.end()) {
-            return it->second;
-        }
-        return {"", 0};
+    // Live keys and timestamps of one shard, so bulk readers can walk the store a shard at a time
+    std::vector<std::pair<std::string, uint64_t>> get_shard_keys_with_timestamps(size_t index) const {
+        const Shard& shard = shards_[index];
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        std::vector<std::pair<std::string, uint64_t>> result;
+        result.reserve(shard.store.size());
+        uint64_t now = wall_clock_ms();
+        shard.store.for_each([&](std::string_view key, const Entry& entry) {
+            if (!entry.stored.tombstone && !is_expired(entry.stored, now)) {
+                result.emplace_back(key, entry.stored.timestamp);
+            }
+        });
+        return result;
+    }
+
+    ValueWithTimestamp get_value_with_timestamp(std::string_view key) const {
+        auto stored = get_ref(key);
+        return {stored.value.str(), stored.timestamp};
+    }
+
+    // Value memory per allocator size class. Values live in the process-wide
+    // SlabAllocator, so this includes values that readers still hold after they were
+    // overwritten or deleted.
+    std::vector<SlabAllocator::ClassStats> memory_stats() const {
+        return SlabAllocator::instance().stats();
+    }
+
+    // Copies one shard, tombstones and TTLs included, while holding only that shard's
+    // lock; used for point-in-time snapshots. Values are shared with the store rather
+    // than copied.
+    std::vector<std::pair<std::string, StoredValue>> copy_shard(size_t index) const {
+        const Shard& shard = shards_[index];
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        std::vector<std::pair<std::string, StoredValue>> result;
+        result.reserve(shard.store.size());
+        shard.store.for_each([&](std::string_view key, const Entry& entry) {
+            result.emplace_back(key, entry.stored);
+        });
+        return result;
     }
 
 private:
-    std::unordered_map<std::string, ValueWithTimestamp> store_;
-    mutable std::recursive_mutex mutex_;
+    // Picks the shard; each shard map hashes again internally
+    struct KeyHash {
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+
+    // What a shard holds per key
+    struct Entry {
+        StoredValue stored;
+        eviction::AccessWord access;  // Updated by readers under the shared lock
+    };
+
+    static constexpr uint64_t default_tombstone_grace_ms = 24 * 60 * 60 * 1000;
+
+    // Approximate footprint of one entry: key and value bytes as allocated, plus a
+    // fixed allowance for the table slot and key bookkeeping
+    static constexpr size_t entry_overhead = 64;
+
+    static int64_t entry_bytes(std::string_view key, const ValueRef& value) {
+        return static_cast<int64_t>(key.size() + value.allocated_bytes() + entry_overhead);
+    }
+
+    // Cache-line aligned so neighbouring shard locks do not false-share. Readers take the
+    // lock shared and never wait on each other; writers hold it exclusively only for the
+    // map update and the index/log appends that must follow store order.
+    struct alignas(64) Shard {
+        ShardMap<Entry> store;
+        TimingWheel expiry;      // Keys with a TTL, by expiry time
+        TimingWheel tombstones;  // Tombstones by timestamp, advanced to the GC horizon
+        mutable std::shared_mutex mutex;
+    };
+
+    static uint64_t wall_clock_ms() { return HybridClock::wall_clock_ms(); }
+
+    // Keeps later local writes ordered after a write stamped elsewhere. Refuses a write
+    // whose timestamp the clock could not follow, unless it is being restored from disk.
+    bool observe(uint64_t timestamp, bool restored) {
+        if (!restored && HybridClock::too_far_ahead(timestamp)) {
+            rejected_writes_.fetch_add(1, std::memory_order_relaxed);
+            KV_LOG_WARN("Refused a write stamped " << HybridClock::physical_ms(timestamp) << " ms, more than "
+                        << HybridClock::max_drift_ms << " ms ahead of the local clock");
+            return false;
+        }
+        clock_.observe(timestamp);
+        return true;
+    }
+
+    static bool is_expired(const StoredValue& stored, uint64_t now) {
+        return !stored.tombstone && stored.expire_at != 0 && stored.expire_at <= now;
+    }
+
+    // Reads the clock only for keys that have a TTL
+    static bool is_live(const StoredValue& stored) {
+        return !stored.tombstone && (stored.expire_at == 0 || stored.expire_at > wall_clock_ms());
+    }
+
+    // The tombstone an expired key turns into. It is stamped with the expiry time, so it
+    // supersedes the write that set the TTL and every replica derives the same one.
+    static StoredValue tombstone_of(const StoredValue& stored) {
+        return {ValueRef(), std::max(stored.timestamp, HybridClock::from_ms(stored.expire_at)), 0, true};
+    }
+
+    // Lazy expiry for writers: under the exclusive lock, turns an entry whose TTL has passed
+    // into its tombstone before it is compared with a new version. Nothing is logged: replay
+    // of the write that set the TTL expires the key again.
+    void settle(Shard& shard, const std::string& key, Entry& entry, uint64_t now, ValueRef& released) {
+        if (!is_expired(entry.stored, now)) {
+            return;
+        }
+        bury(shard, key, entry, tombstone_of(entry.stored).timestamp, released);
+        expired_keys_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Turns entry into a tombstone at timestamp and queues it for collection. The value
+    // moves to released so it is freed after the lock is dropped.
+    void bury(Shard& shard, const std::string& key, Entry& entry, uint64_t timestamp, ValueRef& released) {
+        used_memory_.fetch_sub(static_cast<int64_t>(entry.stored.value.allocated_bytes()), std::memory_order_relaxed);
+        if (!entry.stored.tombstone) {
+            tombstones_.fetch_add(1, std::memory_order_relaxed);
+        }
+        released = std::move(entry.stored.value);
+        entry.stored = StoredValue{ValueRef(), timestamp, 0, true};
+        if (auto index = std::atomic_load(&merkle_index)) {
+            index->upsert(key, "", timestamp, 0, true);
+        }
+        change_log_.record(key);
+        shard.tombstones.schedule(key, HybridClock::physical_ms(timestamp), gc_horizon());
+    }
+
+    // After a write that set expire_at: queues the key on the shard's wheel, or expires it
+    // now if that time has already passed
+    void schedule_expiry(Shard& shard, const std::string& key, Entry& entry, uint64_t now, ValueRef& released) {
+        if (entry.stored.expire_at == 0) {
+            return;
+        }
+        if (entry.stored.expire_at <= now) {
+            settle(shard, key, entry, now, released);
+        } else {
+            shard.expiry.schedule(key, entry.stored.expire_at, now);
+        }
+    }
+
+    bool apply_set(const std::string& key, const std::string& value, uint64_t timestamp, uint64_t expire_at,
+                   bool break_ties, bool restored) {
+        if (!observe(timestamp, restored)) {
+            return false;
+        }
+        Shard& shard = shard_for(key);
+        uint64_t log_sequence = 0;
+        auto wal = std::atomic_load(&write_ahead_log);
+        // Allocated before, and the replaced value freed after, the exclusive section
+        ValueRef stored = ValueRef::make(value);
+        ValueRef expired;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            uint64_t now = wall_clock_ms();
+            Entry* current = shard.store.find(key);
+            if (current) {
+                settle(shard, key, *current, now, expired);
+            }
+            if (current && (timestamp < current->stored.timestamp ||
+                            (break_ties && timestamp == current->stored.timestamp &&
+                             (current->stored.tombstone || std::string_view(value) <= current->stored.value.view())))) {
+                return false;
+            }
+            // Logged before anything changes, so a write the log refuses is not applied at all.
+            // Under the shard lock, so log records and index deltas for a key apply in store order.
+            if (wal) {
+                log_sequence = expire_at
+                    ? wal->append(WriteAheadLog::RECORD_SET_TTL, key, value, timestamp, expire_at)
+                    : wal->append(WriteAheadLog::RECORD_SET, key, value, timestamp);
+            }
+            if (!current) {
+                used_memory_.fetch_add(entry_bytes(key, stored), std::memory_order_relaxed);
+                current = &shard.store.emplace(key, Entry{StoredValue{std::move(stored), timestamp, expire_at},
+                                                          initial_access()});
+            } else {
+                used_memory_.fetch_add(static_cast<int64_t>(stored.allocated_bytes()) -
+                                       static_cast<int64_t>(current->stored.value.allocated_bytes()),
+                                       std::memory_order_relaxed);
+                if (current->stored.tombstone) {
+                    tombstones_.fetch_sub(1, std::memory_order_relaxed);
+                }
+                std::swap(current->stored.value, stored);
+                current->stored.timestamp = timestamp;
+                current->stored.expire_at = expire_at;
+                current->stored.tombstone = false;
+                touch(*current);
+            }
+            if (auto index = std::atomic_load(&merkle_index)) {
+                index->upsert(key, value, timestamp, expire_at, false);
+            }
+            change_log_.record(key);
+            schedule_expiry(shard, key, *current, now, expired);
+        }
+        if (wal) {
+            wal->wait_durable(log_sequence);
+        }
+        evict_to_limit();
+        return true;
+    }
+
+    // create: a key the store does not hold gets the tombstone too, so a replica that
+    // missed the write it deletes will not take it in later
+    bool apply_tombstone(const std::string& key, uint64_t timestamp, bool create, bool restored) {
+        if (!observe(timestamp, restored)) {
+            return false;
+        }
+        Shard& shard = shard_for(key);
+        uint64_t log_sequence = 0;
+        auto wal = std::atomic_load(&write_ahead_log);
+        ValueRef released, expired;  // Freed after the lock is dropped
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            Entry* entry = shard.store.find(key);
+            if (entry) {
+                settle(shard, key, *entry, wall_clock_ms(), expired);
+            }
+            if (!entry) {
+                // Past the horizon the tombstone may already have been collected here
+                if (!create || HybridClock::physical_ms(timestamp) <= gc_horizon()) {
+                    return false;
+                }
+            } else if (timestamp < entry->stored.timestamp ||
+                       (entry->stored.tombstone && (!create || timestamp == entry->stored.timestamp))) {
+                return false;
+            }
+            if (wal) {
+                log_sequence = wal->append(WriteAheadLog::RECORD_DEL, key, "", timestamp);
+            }
+            if (!entry) {
+                used_memory_.fetch_add(entry_bytes(key, ValueRef()), std::memory_order_relaxed);
+                entry = &shard.store.emplace(key, Entry{StoredValue{ValueRef(), timestamp}, initial_access()});
+            }
+            bury(shard, key, *entry, timestamp, released);
+        }
+        if (wal) {
+            wal->wait_durable(log_sequence);
+        }
+        return true;
+    }
+
+    eviction::AccessWord initial_access() const {
+        if (max_memory_.load(std::memory_order_relaxed) == 0) {
+            return eviction::AccessWord();
+        }
+        return eviction::AccessWord(eviction::initial(eviction_policy_.load(std::memory_order_relaxed), eviction::now_ms()));
+    }
+
+    // Without a cap nothing reads the access words, so reads skip the clock
+    void touch(const Entry& entry) const {
+        if (max_memory_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        EvictionPolicy policy = eviction_policy_.load(std::memory_order_relaxed);
+        if (policy != EvictionPolicy::RANDOM) {
+            entry.access.store(eviction::touched(policy, entry.access.load(), eviction::now_ms()));
+        }
+    }
+
+    void evict_to_limit() {
+        size_t limit = max_memory_.load(std::memory_order_relaxed);
+        while (limit != 0 && used_memory() > limit && evict_one()) {
+        }
+    }
+
+    // Evicts one key from the first shard after a random one whose sample has a live key
+    bool evict_one() {
+        size_t start = eviction::random()();
+        for (size_t i = 0; i < shards_.size(); i++) {
+            if (evict_from(shards_[(start + i) % shards_.size()])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Evicts the worst live key of a sample; false if the sample held only tombstones.
+    // The key keeps its Merkle index entry: removing it would make every peer that holds
+    // the key look newer, and anti-entropy would pull it straight back over the cap.
+    bool evict_from(Shard& shard) {
+        ValueRef released;  // Freed after the lock is dropped
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        if (shard.store.size() == 0) {
+            return false;
+        }
+        EvictionPolicy policy = eviction_policy_.load(std::memory_order_relaxed);
+        uint32_t now = eviction::now_ms();
+        std::string victim;
+        uint64_t worst = 0;
+        bool sampled = false;
+        shard.store.sample(eviction::random()(), eviction_samples_.load(std::memory_order_relaxed),
+                           [&](std::string_view key, const Entry& entry) {
+            if (entry.stored.tombstone) return;
+            uint64_t score = eviction::score(policy, entry.access.load(), now);
+            if (!sampled || score > worst) {
+                victim.assign(key);
+                worst = score;
+                sampled = true;
+            }
+        });
+        if (!sampled) {
+            return false;
+        }
+        Entry* entry = shard.store.find(victim);
+        used_memory_.fetch_sub(entry_bytes(victim, entry->stored.value), std::memory_order_relaxed);
+        released = std::move(entry->stored.value);
+        shard.store.erase(victim);
+        evicted_keys_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Shard& shard_for(std::string_view key) {
+        return shards_[KeyHash{}(key) % shards_.size()];
+    }
+
+    const Shard& shard_for(std::string_view key) const {
+        return shards_[KeyHash{}(key) % shards_.size()];
+    }
+
+    static void append_key_value_data(const Shard& shard, IndexInterface::KeyValueData& out) {
+        shard.store.for_each([&](std::string_view key, const Entry& entry) {
+            out[std::string(key)] = {entry.stored.value.str(), entry.stored.timestamp,
+                                     entry.stored.expire_at, entry.stored.tombstone};
+        });
+    }
+
+    std::vector<Shard> shards_;
+    HybridClock clock_;
     std::shared_ptr<IndexInterface> merkle_index;
+    std::shared_ptr<WriteAheadLog> write_ahead_log;
+    ChangeLog change_log_;
+
+    std::atomic<size_t> max_memory_{0};
+    std::atomic<EvictionPolicy> eviction_policy_{EvictionPolicy::LRU};
+    std::atomic<size_t> eviction_samples_{5};
+    std::atomic<int64_t> used_memory_{0};
+    std::atomic<uint64_t> evicted_keys_{0};
+    std::atomic<uint64_t> expired_keys_{0};
+    std::atomic<int64_t> tombstones_{0};
+    std::atomic<uint64_t> collected_tombstones_{0};
+    std::atomic<uint64_t> rejected_writes_{0};
+    std::atomic<uint64_t> tombstone_grace_ms_{default_tombstone_grace_ms};
+    std::atomic<uint64_t> replicated_horizon_{0};
 };
 
 #endif // KV_STORE_HPP
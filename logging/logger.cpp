@@ -0,0 +1,135 @@
+#include "logger.hpp"
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <iostream>
+
+namespace logging {
+
+namespace {
+
+uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+const char* level_name(Level level) {
+    switch (level) {
+    case TRACE: return "TRACE";
+    case DEBUG: return "DEBUG";
+    case INFO: return "INFO";
+    case WARN: return "WARN";
+    case ERROR: return "ERROR";
+    }
+    return "?";
+}
+
+} // namespace
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+std::ostringstream& format_stream() {
+    thread_local std::ostringstream stream;
+    return stream;
+}
+
+Logger::Logger() : slots_(new Slot[capacity]) {
+    for (size_t i = 0; i < capacity; i++) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    writer_ = std::thread([this]() { write_loop(); });
+}
+
+Logger::~Logger() {
+    running_.store(false, std::memory_order_release);
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
+
+void Logger::log(Level level, std::string message) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots_[pos & (capacity - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The writer has not freed this slot yet: the ring is full
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+    slot->level = level;
+    slot->time_ms = now_ms();
+    slot->message = std::move(message);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+bool Logger::try_pop(Slot& out) {
+    // Single consumer, so the position needs no CAS
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[pos & (capacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+        return false;
+    }
+    out.level = slot.level;
+    out.time_ms = slot.time_ms;
+    out.message = std::move(slot.message);
+    slot.message.clear();
+    slot.sequence.store(pos + capacity, std::memory_order_release);
+    dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+void Logger::flush() {
+    size_t target = enqueue_pos_.load(std::memory_order_acquire);
+    while (written_.load(std::memory_order_acquire) < target && writer_.joinable()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void Logger::write_loop() {
+    Slot entry;
+    uint64_t reported_drops = 0;
+    while (true) {
+        bool wrote = false;
+        while (try_pop(entry)) {
+            std::time_t seconds = static_cast<std::time_t>(entry.time_ms / 1000);
+            std::tm local{};
+            localtime_r(&seconds, &local);
+            char stamp[32];
+            std::snprintf(stamp, sizeof(stamp), "%02d:%02d:%02d.%03d", local.tm_hour, local.tm_min,
+                          local.tm_sec, static_cast<int>(entry.time_ms % 1000));
+            std::ostream& out = entry.level >= WARN ? std::cerr : std::cout;
+            out << stamp << " [" << level_name(entry.level) << "] " << entry.message << '\n';
+            written_.fetch_add(1, std::memory_order_release);
+            wrote = true;
+        }
+        uint64_t drops = dropped_.load(std::memory_order_relaxed);
+        if (drops != reported_drops) {
+            std::cerr << "[logger] dropped " << (drops - reported_drops) << " messages (ring full)\n";
+            reported_drops = drops;
+        }
+        if (wrote) {
+            std::cout.flush();
+            std::cerr.flush();
+        } else if (!running_.load(std::memory_order_acquire)) {
+            break;
+        } else {
+            // Idle: poll rather than park, so producers never touch a lock or a condition variable
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+} // namespace logging
@@ -0,0 +1,136 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// Leveled asynchronous logging.
+//
+//   KV_LOG_INFO("Rebuilt Merkle tree with " << count << " key-value pairs");
+//
+// Levels below KV_LOG_LEVEL (a compile definition, INFO by default) expand to
+// nothing, so their arguments are never evaluated. Enabled messages are formatted
+// on the calling thread and pushed onto a bounded lock-free ring; one writer thread
+// drains it to stdout (stderr for WARN and ERROR). A request thread never waits on
+// the terminal or a file: when the ring is full the message is dropped and counted.
+#define KV_LOG_LEVEL_TRACE 0
+#define KV_LOG_LEVEL_DEBUG 1
+#define KV_LOG_LEVEL_INFO 2
+#define KV_LOG_LEVEL_WARN 3
+#define KV_LOG_LEVEL_ERROR 4
+#define KV_LOG_LEVEL_OFF 5
+
+#ifndef KV_LOG_LEVEL
+#define KV_LOG_LEVEL KV_LOG_LEVEL_INFO
+#endif
+
+namespace logging {
+
+enum Level : uint8_t {
+    TRACE = KV_LOG_LEVEL_TRACE,
+    DEBUG = KV_LOG_LEVEL_DEBUG,
+    INFO = KV_LOG_LEVEL_INFO,
+    WARN = KV_LOG_LEVEL_WARN,
+    ERROR = KV_LOG_LEVEL_ERROR
+};
+
+class Logger {
+public:
+    static Logger& instance();
+
+    // Runtime filter on top of the compile-time one
+    void set_level(Level level) { level_.store(level, std::memory_order_relaxed); }
+    bool enabled(Level level) const { return level >= level_.load(std::memory_order_relaxed); }
+
+    // Queues a formatted message; never blocks
+    void log(Level level, std::string message);
+
+    // Blocks until everything queued so far has been written
+    void flush();
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    ~Logger();
+
+private:
+    static constexpr size_t capacity = 8192;  // Power of two
+
+    // Bounded MPMC ring after Vyukov: each slot's sequence says whether it is free for
+    // the producer at that position or filled for the consumer
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Level level;
+        uint64_t time_ms;
+        std::string message;
+    };
+
+    Logger();
+    bool try_pop(Slot& out);
+    void write_loop();
+
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+    alignas(64) std::atomic<size_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint8_t> level_{KV_LOG_LEVEL < KV_LOG_LEVEL_OFF ? KV_LOG_LEVEL : KV_LOG_LEVEL_ERROR};
+    std::atomic<bool> running_{true};
+    std::thread writer_;
+};
+
+// Reused per thread so formatting a message allocates only its final string
+std::ostringstream& format_stream();
+
+} // namespace logging
+
+#define KV_LOG_AT(level, expr)                                                  \
+    do {                                                                        \
+        auto& kv_logger_ = ::logging::Logger::instance();                       \
+        if (kv_logger_.enabled(level)) {                                        \
+            auto& kv_log_stream_ = ::logging::format_stream();                  \
+            kv_log_stream_.str(std::string());                                  \
+            kv_log_stream_ << expr;                                             \
+            kv_logger_.log(level, kv_log_stream_.str());                        \
+        }                                                                       \
+    } while (0)
+
+#define KV_LOG_DISABLED(expr) \
+    do {                      \
+    } while (0)
+
+#if KV_LOG_LEVEL <= KV_LOG_LEVEL_TRACE
+#define KV_LOG_TRACE(expr) KV_LOG_AT(::logging::TRACE, expr)
+#else
+#define KV_LOG_TRACE(expr) KV_LOG_DISABLED(expr)
+#endif
+
+#if KV_LOG_LEVEL <= KV_LOG_LEVEL_DEBUG
+#define KV_LOG_DEBUG(expr) KV_LOG_AT(::logging::DEBUG, expr)
+#else
+#define KV_LOG_DEBUG(expr) KV_LOG_DISABLED(expr)
+#endif
+
+#if KV_LOG_LEVEL <= KV_LOG_LEVEL_INFO
+#define KV_LOG_INFO(expr) KV_LOG_AT(::logging::INFO, expr)
+#else
+#define KV_LOG_INFO(expr) KV_LOG_DISABLED(expr)
+#endif
+
+#if KV_LOG_LEVEL <= KV_LOG_LEVEL_WARN
+#define KV_LOG_WARN(expr) KV_LOG_AT(::logging::WARN, expr)
+#else
+#define KV_LOG_WARN(expr) KV_LOG_DISABLED(expr)
+#endif
+
+#if KV_LOG_LEVEL <= KV_LOG_LEVEL_ERROR
+#define KV_LOG_ERROR(expr) KV_LOG_AT(::logging::ERROR, expr)
+#else
+#define KV_LOG_ERROR(expr) KV_LOG_DISABLED(expr)
+#endif
+
+#endif // LOGGER_HPP
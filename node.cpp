@@ -3,39 +3,140 @@
 #include <iomanip> // for std::setfill, std::setw, std::hex
 #include <boost/asio.hpp>
 #include "anti_entropy/merkle_tree_index.hpp"
+#include "logging/logger.hpp"
 
-Node::Node(boost::asio::io_context& io_context, short port, const std::string& peer_host, short peer_port)
-    : acceptor_(io_context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)),
-      kv_store_(),
-      peer_host_(std::move(peer_host)),
-      peer_port_(peer_port) {
-    start_accept();
+Node::Node(boost::asio::io_context& io_context, short port, const std::string& peer_host, short peer_port,
+           size_t shard_count)
+    : Node({&io_context}, false, pair_config(port, peer_host, peer_port), shard_count) {}
+
+Node::Node(IoContextPool& pool, short port, const std::string& peer_host, short peer_port,
+           size_t shard_count)
+    : Node(pool, pair_config(port, peer_host, peer_port), shard_count) {}
+
+Node::Node(IoContextPool& pool, const ClusterConfig& config, size_t shard_count)
+    : Node(pool.contexts(), pool.mode() == IoContextPool::PER_CORE, config, shard_count) {}
+
+Node::Node(const std::vector<boost::asio::io_context*>& contexts, bool reuse_port, const ClusterConfig& config,
+           size_t shard_count)
+    : io_context_(*contexts.front()),
+      kv_store_(shard_count),
+      config_(config) {
+    kv_store_.clock().set_node_id(config.node_id);
+    {
+        std::unique_lock<std::shared_mutex> lock(peers_mutex_);
+        rebuild_ring();
+    }
+    for (auto* context : contexts) {
+        acceptors_.push_back(open_acceptor(*context, config.self.port, reuse_port));
+    }
+    expiry_reaper_ = std::make_unique<ExpiryReaper>(kv_store_);
+    expiry_reaper_->start();
+    membership_ = std::make_unique<Membership>(config);
+    membership_->set_listener([this](const Membership::Member& member) { on_member_change(member); });
+    membership_->start();
+    for (auto& acceptor : acceptors_) {
+        start_accept(*acceptor);
+    }
 }
 
-void Node::start_anti_entropy() {
-    std::cout << "start_anti_entropy: entered" << std::endl;
-    boost::asio::io_context& io_context = static_cast<boost::asio::io_context&>(acceptor_.get_executor().context());
+ClusterConfig Node::pair_config(short port, const std::string& peer_host, short peer_port) {
+    ClusterConfig config;
+    // The low byte of the port tells the two nodes apart
+    config.node_id = static_cast<uint8_t>(port);
+    config.self = {"127.0.0.1", port};
+    if (!peer_host.empty() && peer_port > 0) {
+        config.seeds.push_back({peer_host, peer_port});
+    }
+    return config;
+}
+
+void Node::on_member_change(const Membership::Member& member) {
+    std::unique_lock<std::shared_mutex> lock(peers_mutex_);
+    Peer& peer = peers_[member.address.to_string()];
+    if (!peer.sender) {
+        peer.address = member.address;
+        peer.sender = std::make_unique<ReplicationSender>(member.address.host, member.address.port);
+        peer.sender->start();
+    }
+    bool live = member.state != Membership::State::DEAD;
+    if (peer.live != live) {
+        peer.live = live;
+        rebuild_ring();
+    }
+}
+
+void Node::rebuild_ring() {
+    std::vector<ClusterConfig::Address> nodes = {config_.self};
+    for (const auto& [address, peer] : peers_) {
+        if (peer.live) nodes.push_back(peer.address);
+    }
+    ring_ = std::make_shared<const HashRing>(std::move(nodes), config_.vnodes, config_.replication_factor);
+    replicas_.assign(HashRing::partitions, {});
+    size_t owned = 0;
+    for (size_t partition = 0; partition < HashRing::partitions; partition++) {
+        for (const auto& owner : ring_->owners(partition)) {
+            if (owner == config_.self) continue;
+            replicas_[partition].push_back(peers_.at(owner.to_string()).sender.get());
+        }
+        bool owns = ring_->owns(config_.self, partition);
+        owned_[partition].store(owns, std::memory_order_relaxed);
+        owned += owns;
+    }
+    KV_LOG_INFO("Hash ring rebuilt over " << ring_->nodes().size() << " nodes; this node owns "
+                << owned << " of " << HashRing::partitions << " partitions");
+}
 
+Node::~Node() {
+    // Stop snapshots and flush the log while the store they read is still alive
+    persistence_manager_.reset();
+}
+
+void Node::start_anti_entropy() {
     auto merkle_index = std::make_shared<MerkleTreeIndex>();
-    std::cout << "start_anti_entropy: merkle_index created" << std::endl;
-    std::cout << "start_anti_entropy: about to set_merkle_index" << std::endl;
     kv_store_.set_merkle_index(merkle_index);
-    std::cout << "start_anti_entropy: merkle_index set in kv_store_" << std::endl;
+    anti_entropy_manager_ = std::make_unique<AntiEntropyManager>(io_context_, kv_store_, *membership_, merkle_index);
+    anti_entropy_manager_->start();
+    KV_LOG_INFO("Started anti-entropy with Merkle tree synchronization");
+}
 
-    anti_entropy_manager_ = std::make_unique<AntiEntropyManager>(
-        io_context, kv_store_, peer_host_, peer_port_, merkle_index);
-    std::cout << "start_anti_entropy: anti_entropy_manager_ created" << std::endl;
+void Node::enable_persistence(const std::string& directory, PersistenceManager::Options options) {
+    persistence_manager_ = std::make_unique<PersistenceManager>(directory, kv_store_, options);
+    persistence_manager_->recover();
+    persistence_manager_->start();
+}
 
-    anti_entropy_manager_->start();
-    std::cout << "Started anti-entropy with Merkle tree synchronization" << std::endl;
+void Node::set_max_memory(size_t max_memory, EvictionPolicy policy) {
+    kv_store_.set_max_memory(max_memory, policy);
+    if (max_memory) {
+        KV_LOG_INFO("Memory capped at " << max_memory << " bytes");
+    }
+}
+
+std::unique_ptr<tcp::acceptor> Node::open_acceptor(boost::asio::io_context& io_context, short port, bool reuse_port) {
+    tcp::endpoint endpoint(tcp::v4(), port);
+    auto acceptor = std::make_unique<tcp::acceptor>(io_context);
+    acceptor->open(endpoint.protocol());
+    acceptor->set_option(tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+    if (reuse_port) {
+        acceptor->set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+    }
+#endif
+    acceptor->bind(endpoint);
+    acceptor->listen();
+    return acceptor;
 }
 
-void Node::start_accept() {
-    acceptor_.async_accept(
-        [this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
+// Each accepted session runs on the acceptor's context
+void Node::start_accept(tcp::acceptor& acceptor) {
+    acceptor.async_accept(
+        [this, &acceptor](boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
             if (!ec) {
+                // Replies go out as soon as a batch is done; Nagle would hold them for the client's delayed ACK
+                boost::system::error_code ignored;
+                socket.set_option(tcp::no_delay(true), ignored);
                 std::make_shared<Session>(std::move(socket), this)->start();
             }
-            start_accept();
+            start_accept(acceptor);
         });
 }
@@ -3,15 +3,32 @@
 
 #include "kv_store.hpp"
 #include "anti_entropy/anti_entropy_manager.hpp"
+#include "protocol/binary_protocol.hpp"
+#include "protocol/frame_reader.hpp"
+#include "protocol/text_parser.hpp"
+#include "replication/replication_sender.hpp"
+#include "cluster/cluster_config.hpp"
+#include "cluster/membership.hpp"
+#include "cluster/hash_ring.hpp"
+#include "persistence/persistence_manager.hpp"
+#include "storage/expiry_reaper.hpp"
+#include "io_context_pool.hpp"
 #include <boost/asio.hpp>
-#include <iostream>
+#include "logging/logger.hpp"
 #include <thread>
 #include <memory>
 #include <array>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <shared_mutex>
+#include <cstring>
+#include <string_view>
 #include <unordered_map>
 #include <sstream>
 #include <chrono>
 #include <iomanip>
+#include <algorithm>
 
 using boost::asio::ip::tcp;
 
@@ -24,255 +41,816 @@ public:
     Node(boost::asio::io_context& io_context,
          short port,
          const std::string& peer_host = "",
-         short peer_port = 0);
+         short peer_port = 0,
+         size_t shard_count = 64);
+    // Serves clients on every thread of the pool: one acceptor on the shared context, or
+    // one SO_REUSEPORT acceptor per context in PER_CORE mode
+    Node(IoContextPool& pool,
+         short port,
+         const std::string& peer_host = "",
+         short peer_port = 0,
+         size_t shard_count = 64);
+    // A member of a cluster of any size: finds the other members by gossip, starting from
+    // the config's seeds, and holds the partitions the hash ring gives it
+    Node(IoContextPool& pool, const ClusterConfig& config, size_t shard_count = 64);
+    ~Node();
+
+    // Rounds of writes a partition transfer catches up on after its bulk copy
+    static constexpr size_t max_catch_up_passes = 16;
          
-    // Session class for handling client connections
+    // One response queued on a session; binary replies carry a frame header
+    struct Reply {
+        bool binary = false;
+        std::array<char, binary_protocol::kResponseHeaderSize> header;
+        std::string body;
+        // A stored value sent as the payload in place of body, without copying it
+        ValueRef value;
+        // Set for streamed replies instead of header/body: fills the next chunk and
+        // returns false once it has produced the last one
+        std::function<bool(std::string&)> stream;
+
+        std::string_view payload() const { return value.empty() ? std::string_view(body) : value.view(); }
+    };
+
+    // Session class for handling client connections. A session stays open until the
+    // client closes it and serves any number of commands per read: newline-terminated
+    // text commands, or binary frames once the client has sent "PROTOCOL BINARY".
     class Session : public std::enable_shared_from_this<Session> {
     public:
         Session(tcp::socket socket, Node* node)
-            : socket_(std::move(socket)), node_(node) {}
+            : socket_(std::move(socket)), node_(node), buffer_(initial_buffer_size) {}
         
         void start() {
             do_read();
         }
         
     private:
+        static constexpr size_t initial_buffer_size = 4096;
+        // Upper bound on a single command line or frame still waiting for its last byte
+        static constexpr size_t max_request_size = 16 * 1024 * 1024;
+
         void do_read() {
+            if (filled_ == buffer_.size()) {
+                buffer_.resize(buffer_.size() * 2);  // A partial request fills the buffer
+            } else if (filled_ == 0 && buffer_.size() > initial_buffer_size) {
+                buffer_.resize(initial_buffer_size);
+                buffer_.shrink_to_fit();
+            }
             auto self(shared_from_this());
-            socket_.async_read_some(boost::asio::buffer(data_),
+            socket_.async_read_some(boost::asio::buffer(buffer_.data() + filled_, buffer_.size() - filled_),
                 [this, self](boost::system::error_code ec, std::size_t length) {
                     if (!ec) {
-                        std::string request(data_.data(), length);
-                        std::string response = node_->process_command(request);
-                        do_write(response);
+                        filled_ += length;
+                        handle_requests();
+                    } else if (ec == boost::asio::error::eof && filled_ > 0 && !binary_) {
+                        // The client finished sending; answer a final command that had no newline
+                        Reply reply;
+                        node_->process_command(std::string_view(buffer_.data(), filled_), reply);
+                        replies_.push_back(std::move(reply));
+                        filled_ = 0;
+                        closing_ = true;
+                        do_write();
                     }
                 });
         }
+
+        // Answers what is buffered, then either writes the replies or reads more
+        void handle_requests() {
+            size_t used = process_buffer();
+            std::memmove(buffer_.data(), buffer_.data() + used, filled_ - used);
+            filled_ -= used;
+            if (invalid_ || filled_ > max_request_size) {
+                KV_LOG_WARN("Closing session: malformed or oversized request");
+                return;
+            }
+            if (!replies_.empty()) {
+                do_write();
+            } else if (stream_) {
+                write_stream_chunk();
+            } else {
+                do_read();
+            }
+        }
+
+        // Runs every complete request in the receive buffer, parsing in place, and
+        // returns how many bytes were consumed. A partial trailing request is kept.
+        size_t process_buffer() {
+            size_t pos = 0;
+            while (pos < filled_) {
+                const char* data = buffer_.data() + pos;
+                size_t size = filled_ - pos;
+                if (binary_) {
+                    binary_protocol::Request request;
+                    size_t consumed = 0;
+                    auto result = binary_protocol::parse_request(data, size, max_request_size, request, consumed);
+                    if (result != binary_protocol::ParseResult::OK) {
+                        invalid_ = result == binary_protocol::ParseResult::INVALID;
+                        break;
+                    }
+                    pos += consumed;
+                    Reply reply;
+                    reply.binary = true;
+                    if (node_->process_binary(request, reply)) {
+                        if (reply.stream) {
+                            // Later requests wait until the whole stream has been sent
+                            stream_ = std::move(reply.stream);
+                            break;
+                        }
+                        replies_.push_back(std::move(reply));
+                    }
+                } else {
+                    const char* newline = static_cast<const char*>(std::memchr(data, '\n', size));
+                    if (!newline) break;
+                    std::string_view line(data, newline - data);
+                    pos += line.size() + 1;
+                    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                    if (line.empty()) continue;
+                    Reply reply;
+                    if (line == binary_protocol::kHandshake) {
+                        binary_ = true;
+                        reply.body = "OK";
+                    } else {
+                        node_->process_command(line, reply);
+                    }
+                    replies_.push_back(std::move(reply));
+                }
+            }
+            return pos;
+        }
         
-        void do_write(const std::string& response) {
+        // Sends every reply of the batch, in request order, with one gathered write
+        void do_write() {
             auto self(shared_from_this());
-            boost::asio::async_write(socket_, boost::asio::buffer(response),
+            std::vector<boost::asio::const_buffer> buffers;
+            buffers.reserve(replies_.size() * 2);
+            for (const auto& reply : replies_) {
+                if (reply.binary) {
+                    buffers.push_back(boost::asio::buffer(reply.header));
+                    buffers.push_back(boost::asio::buffer(reply.payload().data(), reply.payload().size()));
+                } else {
+                    buffers.push_back(boost::asio::buffer(reply.payload().data(), reply.payload().size()));
+                    buffers.push_back(boost::asio::buffer("\n", 1));
+                }
+            }
+            boost::asio::async_write(socket_, buffers,
                 [this, self](boost::system::error_code ec, std::size_t) {
-                    if (!ec) {
-                        // Connection closed after write
+                    replies_.clear();
+                    if (ec || closing_) {
+                        return;
+                    }
+                    if (stream_) {
+                        write_stream_chunk();
+                    } else {
+                        handle_requests();
                     }
                 });
         }
+
+        // Sends a streamed reply one bounded chunk at a time; the next chunk is only
+        // produced once the previous one has been written
+        void write_stream_chunk() {
+            Reply chunk;
+            chunk.binary = true;
+            bool more = stream_(chunk.body);
+            binary_protocol::encode_response_header(chunk.header.data(),
+                more ? binary_protocol::STATUS_MORE : binary_protocol::STATUS_OK,
+                static_cast<uint32_t>(chunk.body.size()));
+            if (!more) {
+                stream_ = nullptr;
+            }
+            replies_.push_back(std::move(chunk));
+            do_write();
+        }
         
         tcp::socket socket_;
         Node* node_;
-        std::array<char, 1024> data_;
+        std::vector<char> buffer_;
+        size_t filled_ = 0;
+        std::vector<Reply> replies_;
+        std::function<bool(std::string&)> stream_;
+        bool binary_ = false;
+        bool invalid_ = false;
+        bool closing_ = false;
     };
 
-    // Start accepting client connections
-    void start_accept();
+    // Start accepting client connections on one of the node's acceptors
+    void start_accept(tcp::acceptor& acceptor);
     
     // Start the anti-entropy synchronization process
     void start_anti_entropy();
 
-    std::string process_command(const std::string& command) {
-        std::cout << "[process_command] Received: '" << command << "'" << std::endl;
-        std::istringstream iss(command);
-        std::string first, action, key, value;
-        iss >> first;
+    // Recovers the store from the snapshot and write-ahead log in directory, then
+    // logs every further write there. Call before the io_context starts serving clients.
+    void enable_persistence(const std::string& directory,
+                            PersistenceManager::Options options = PersistenceManager::Options());
+
+    // Caps the store's memory; writes past the cap evict keys locally (see
+    // KeyValueStore::set_max_memory). 0 removes the cap.
+    void set_max_memory(size_t max_memory, EvictionPolicy policy = EvictionPolicy::LRU);
 
-        bool is_propagated = false;
-        if (first == "PROPAGATE") {
-            is_propagated = true;
-            iss >> action >> key >> value;
+    // Executes one text command line into reply. The parser only slices the line, and
+    // a GET hands the stored value to the reply without copying it.
+    void process_command(std::string_view command, Reply& reply) {
+        KV_LOG_DEBUG("[process_command] Received: '" << command << "'");
+        text_protocol::Request request = text_protocol::parse(command);
+        if (is_keyed(request.command) && request.key.size() > binary_protocol::kMaxKeySize) {
+            // It could be neither replicated nor synced: every binary frame carries a u16 key length
+            reply.body = "ERROR: Key too long";
+        } else if (is_keyed(request.command) && !request.propagated && !owns(request.key)) {
+            reply.body = "MOVED " + primary_of(request.key);
+        } else if (request.command == text_protocol::Command::GET) {
+            reply.value = kv_store_.get_ref(request.key).value;
         } else {
-            action = first;
-            iss >> key >> value;
+            try {
+                reply.body = execute_command(request);
+            } catch (const std::exception& e) {
+                // A write the write-ahead log could not make durable
+                KV_LOG_WARN("Command failed: " << e.what());
+                reply.body = std::string("ERROR: ") + e.what();
+            }
         }
+    }
 
-        if (action == "GET") {
-            return kv_store_.get(key);
-        } else if (action == "SET") {
-            uint64_t timestamp = current_timestamp();
-            kv_store_.set(key, value, timestamp);
-            if (!is_propagated) propagate_update("PROPAGATE SET " + key + " " + value + " " + std::to_string(timestamp));
+    std::string execute_command(const text_protocol::Request& request) {
+        switch (request.command) {
+        case text_protocol::Command::GET:
+            return kv_store_.get(request.key);
+        case text_protocol::Command::SET: {
+            // SET <key> <value> [EX <seconds>]
+            uint64_t timestamp = request.propagated ? request.timestamp : current_timestamp();
+            uint64_t ttl_seconds = 0;
+            if (!text_protocol::parse_set_options(request.options, ttl_seconds)) {
+                return "ERROR: Invalid expire time";
+            }
+            uint64_t expire_at = ttl_seconds ? HybridClock::physical_ms(timestamp) + ttl_seconds * 1000 : 0;
+            std::string key(request.key), value(request.value);
+            if (request.propagated) {
+                // Losing to a newer write is how replicas converge; only a refused timestamp is an error
+                bool applied = kv_store_.merge(key, value, timestamp, expire_at);
+                return applied || !HybridClock::too_far_ahead(timestamp) ? "OK" : "ERROR: Timestamp too far ahead";
+            }
+            if (!kv_store_.set(key, value, timestamp, expire_at)) {
+                return "ERROR: Superseded by a newer write";
+            }
+            propagate_update(binary_protocol::OP_SET, key, value, timestamp, expire_at);
+            return "OK";
+        }
+        case text_protocol::Command::EXPIRE: {
+            // EXPIRE <key> <seconds>: replicated as a SET of the current value with the new TTL
+            uint64_t timestamp = request.propagated ? request.timestamp : current_timestamp();
+            uint64_t ttl_seconds;
+            if (!text_protocol::parse_ttl(request.value, ttl_seconds)) {
+                return "ERROR: Invalid expire time";
+            }
+            std::string key(request.key);
+            auto updated = kv_store_.expire(key, HybridClock::physical_ms(timestamp) + ttl_seconds * 1000, timestamp);
+            if (updated.timestamp == 0) {
+                if (request.propagated && HybridClock::too_far_ahead(timestamp)) {
+                    return "ERROR: Timestamp too far ahead";
+                }
+                return superseded(key, timestamp) ? "ERROR: Superseded by a newer write" : "ERROR: Key not found";
+            }
+            if (!request.propagated) {
+                propagate_update(binary_protocol::OP_SET, key, updated.value.str(), timestamp, updated.expire_at);
+            }
             return "OK";
-        } else if (action == "DEL") {
+        }
+        case text_protocol::Command::DEL: {
+            std::string key(request.key);
+            if (request.propagated) {
+                bool applied = kv_store_.merge_tombstone(key, request.timestamp);
+                return applied || !HybridClock::too_far_ahead(request.timestamp) ? "OK" : "ERROR: Timestamp too far ahead";
+            }
             uint64_t timestamp = current_timestamp();
-            kv_store_.del(key, timestamp);
-            if (!is_propagated) propagate_update("PROPAGATE DEL " + key + " " + value + " " + std::to_string(timestamp));
+            if (!kv_store_.del(key, timestamp) && superseded(key, timestamp)) {
+                return "ERROR: Superseded by a newer write";
+            }
+            propagate_update(binary_protocol::OP_DEL, key, "", timestamp);
             return "OK";
-        } else if (action == "GET_ALL") {
+        }
+        case text_protocol::Command::GET_ALL: {
             // Return all keys with timestamps for anti-entropy
-            auto keys = kv_store_.get_all_keys_with_timestamps();
-            std::stringstream ss;
-            for (const auto& [key, ts] : keys) {
-                ss << key << ":" << ts << ";";
+            std::string result;
+            for (const auto& [key, ts] : kv_store_.get_all_keys_with_timestamps()) {
+                result += key;
+                result += ':';
+                result += std::to_string(ts);
+                result += ';';
             }
-            return ss.str();
-        } else if (action == "GET_MERKLE_ROOT") {
-            // Get the Merkle root hash
-            // Find the anti-entropy manager via friend pointer
-            if (anti_entropy_manager_ && anti_entropy_manager_->get_merkle_index()) {
-                auto root_hash = anti_entropy_manager_->get_merkle_index()->get_root_hash();
-                return root_hash.to_string();
-            }
-            return "EMPTY"; // No Merkle tree available
-        } else if (action == "GET_PATHS") {
-            // Get Merkle paths for the requested keys
-            if (!anti_entropy_manager_ || !anti_entropy_manager_->get_merkle_index()) {
+            return result;
+        }
+        case text_protocol::Command::GET_MERKLE_ROOT: {
+            auto index = merkle_index();
+            return index ? index->get_root_hash().to_string() : "EMPTY";
+        }
+        case text_protocol::Command::GET_MERKLE_LEVEL: {
+            // GET_MERKLE_LEVEL <level> <node;node;...>: hashes of the nodes fan_out_bits
+            // levels below each listed node, "-" for an empty subtree
+            auto index = merkle_index();
+            if (!index) {
+                return "EMPTY";
+            }
+            uint64_t level;
+            if (!text_protocol::parse_uint(request.key, level)) {
+                return "ERROR: Invalid level";
+            }
+            level = std::min<uint64_t>(level, index->depth());
+            size_t span = std::min(AntiEntropyManager::fan_out_bits, index->depth() - level);
+            std::string result;
+            for (const auto& hash : index->get_subtree_hashes(level, parse_index_list(request.value), span)) {
+                result += hash == merkle::Hash() ? "-" : hash.to_string();
+                result += ';';
+            }
+            return result;
+        }
+        case text_protocol::Command::GET_BUCKETS: {
+            // GET_BUCKETS <bucket;bucket;...>: key:timestamp of every entry in those buckets
+            auto index = merkle_index();
+            if (!index) {
+                return "EMPTY";
+            }
+            std::string result;
+            for (const auto& entry : index->get_bucket_entries(parse_index_list(request.key))) {
+                result += entry.key;
+                result += ':';
+                result += std::to_string(entry.timestamp);
+                result += ';';
+            }
+            return result;
+        }
+        case text_protocol::Command::GET_PATHS: {
+            // GET_PATHS <key;key;...>: each key with the hex-encoded Merkle path of its bucket
+            auto index = merkle_index();
+            if (!index) {
                 return "EMPTY";
             }
-            
-            // Parse requested keys
             std::vector<std::string> keys;
-            std::string rest_of_command;
-            std::getline(iss, rest_of_command);
-            
-            size_t start = 0;
-            while (start < rest_of_command.size()) {
-                size_t end = rest_of_command.find(';', start);
-                if (end == std::string::npos) {
-                    if (start < rest_of_command.size()) {
-                        keys.push_back(rest_of_command.substr(start));
-                    }
-                    break;
-                }
-                
-                keys.push_back(rest_of_command.substr(start, end - start));
-                start = end + 1;
-            }
-            
-            // Get paths for these keys
-            auto paths = anti_entropy_manager_->get_merkle_index()->get_paths(keys);
-            
-            // Format response
+            text_protocol::for_each_item(request.args, [&](std::string_view key) { keys.emplace_back(key); });
+            auto paths = index->get_paths(keys);
+
             std::stringstream ss;
             for (size_t i = 0; i < keys.size() && i < paths.size(); i++) {
                 std::vector<uint8_t> serialized_path = paths[i];
-                
-                // Convert binary path to hex string
-                std::stringstream path_ss;
+                ss << keys[i] << ",";
                 for (auto byte : serialized_path) {
-                    path_ss << std::setfill('0') << std::setw(2) << std::hex << static_cast<int>(byte);
+                    ss << std::setfill('0') << std::setw(2) << std::hex << static_cast<int>(byte);
                 }
-                
-                ss << keys[i] << "," << path_ss.str() << ";";
+                ss << ";";
             }
-            
             return ss.str();
         }
-        
-        return "Invalid command";
+        case text_protocol::Command::STATS: {
+            // STATS: memory:used:max:evicted_keys, expired:expired_keys,
+            // tombstones:held:collected and rejected:writes for the store, then
+            // chunk_size:chunks:bytes_requested:bytes_allocated:bytes_reserved for every
+            // value size class in use, "large" for values beyond the slab classes
+            std::string result = "memory:" + std::to_string(kv_store_.used_memory()) + ':' +
+                                 std::to_string(kv_store_.max_memory()) + ':' +
+                                 std::to_string(kv_store_.evicted_keys()) + ';';
+            result += "expired:" + std::to_string(kv_store_.expired_keys()) + ';';
+            result += "tombstones:" + std::to_string(kv_store_.tombstones()) + ':' +
+                      std::to_string(kv_store_.collected_tombstones()) + ';';
+            result += "rejected:" + std::to_string(kv_store_.rejected_writes()) + ';';
+            for (const auto& stats : kv_store_.memory_stats()) {
+                if (stats.chunks == 0 && stats.bytes_reserved == 0) continue;
+                result += stats.chunk_size ? std::to_string(stats.chunk_size) : "large";
+                result += ':' + std::to_string(stats.chunks);
+                result += ':' + std::to_string(stats.bytes_requested);
+                result += ':' + std::to_string(stats.bytes_allocated);
+                result += ':' + std::to_string(stats.bytes_reserved);
+                result += ';';
+            }
+            return result;
+        }
+        case text_protocol::Command::CLUSTER: {
+            // CLUSTER: node_id,host:port,state of this node ("self") and every member it knows
+            std::string result = std::to_string(config_.node_id) + ',' + config_.self.to_string() + ",self;";
+            for (const auto& member : membership_->members()) {
+                result += std::to_string(member.node_id) + ',' + member.address.to_string() + ',' +
+                          Membership::state_name(member.state) + ';';
+            }
+            return result;
+        }
+        default:
+            return "Invalid command";
+        }
     }
 
-    void propagate_update(const std::string& command) {
-        if (!peer_host_.empty() && peer_port_ > 0) {
-            std::thread([this, command]() {
-                int retry_count = 0;
-                const int max_retries = 5;
-                const int initial_delay = 100; // milliseconds
-                
-                while (retry_count < max_retries) {
-                    try {
-                        int delay = initial_delay * (1 << retry_count); // exponential backoff
-                        std::this_thread::sleep_for(std::chrono::milliseconds(delay));
-                        
-                        tcp::socket socket(acceptor_.get_executor());
-                        tcp::resolver resolver(acceptor_.get_executor());
-                        boost::asio::connect(socket, resolver.resolve(peer_host_, std::to_string(peer_port_)));
-                        boost::asio::write(socket, boost::asio::buffer(command));
-                        return; // Success, exit the retry loop
-                    } catch (std::exception& e) {
-                        std::cerr << "Failed to propagate update (attempt " 
-                                  << (retry_count + 1) << "): " << e.what() << "\n";
-                        retry_count++;
-                    }
+    // Executes one binary frame; returns false when no reply should be sent
+    bool process_binary(const binary_protocol::Request& request, Reply& reply) {
+        try {
+            return execute_binary(request, reply);
+        } catch (const std::exception& e) {
+            // A write the write-ahead log could not make durable
+            KV_LOG_WARN("Request failed: " << e.what());
+            reply = Reply();
+            reply.binary = true;
+            reply.body = e.what();
+            binary_protocol::encode_response_header(reply.header.data(), binary_protocol::STATUS_ERROR,
+                                                    static_cast<uint32_t>(reply.body.size()));
+            return !(request.flags & binary_protocol::FLAG_QUIET);
+        }
+    }
+
+    bool execute_binary(const binary_protocol::Request& request, Reply& reply) {
+        binary_protocol::Status status = binary_protocol::STATUS_OK;
+        bool is_propagated = request.flags & binary_protocol::FLAG_PROPAGATED;
+        // Only a replicated write keeps the timestamp it was stamped with elsewhere; a client's
+        // is ignored, or it could stamp a key so far ahead that no later write could replace it
+        uint64_t timestamp = is_propagated && request.timestamp ? request.timestamp : current_timestamp();
+
+        if (request.opcode <= binary_protocol::OP_DEL && !is_propagated && !owns(request.key)) {
+            reply.body = primary_of(request.key);
+            binary_protocol::encode_response_header(reply.header.data(), binary_protocol::STATUS_MOVED,
+                                                    static_cast<uint32_t>(reply.body.size()));
+            return !(request.flags & binary_protocol::FLAG_QUIET);
+        }
+
+        switch (request.opcode) {
+        case binary_protocol::OP_GET: {
+            auto stored = kv_store_.get_ref(request.key);
+            if (stored.timestamp == 0) {
+                status = binary_protocol::STATUS_NOT_FOUND;
+            } else {
+                reply.value = std::move(stored.value);
+            }
+            break;
+        }
+        case binary_protocol::OP_SET: {
+            std::string_view payload = request.value;
+            uint64_t expire_at = 0;
+            if (request.flags & binary_protocol::FLAG_TTL) {
+                if (payload.size() < 8) {
+                    status = binary_protocol::STATUS_ERROR;
+                    break;
                 }
-                std::cerr << "Failed to propagate update after " << max_retries << " attempts\n";
-            }).detach();
+                expire_at = binary_protocol::load_u64(payload.data());
+                payload.remove_prefix(8);
+            }
+            std::string key(request.key), value(payload);
+            if (is_propagated) {
+                if (!kv_store_.merge(key, value, timestamp, expire_at) && HybridClock::too_far_ahead(timestamp)) {
+                    status = binary_protocol::STATUS_ERROR;
+                    reply.body = "timestamp too far ahead";
+                }
+            } else if (!kv_store_.set(key, value, timestamp, expire_at)) {
+                status = binary_protocol::STATUS_ERROR;
+                reply.body = "superseded by a newer write";
+            } else {
+                propagate_update(binary_protocol::OP_SET, key, value, timestamp, expire_at);
+            }
+            break;
+        }
+        case binary_protocol::OP_DEL: {
+            std::string key(request.key);
+            if (is_propagated) {
+                // The tombstone is kept even if this replica never saw the key
+                if (!kv_store_.merge_tombstone(key, timestamp) && HybridClock::too_far_ahead(timestamp)) {
+                    status = binary_protocol::STATUS_ERROR;
+                    reply.body = "timestamp too far ahead";
+                }
+                break;
+            }
+            if (!kv_store_.del(key, timestamp)) {
+                if (superseded(key, timestamp)) {
+                    status = binary_protocol::STATUS_ERROR;
+                    reply.body = "superseded by a newer write";
+                    break;
+                }
+                status = binary_protocol::STATUS_NOT_FOUND;
+            }
+            propagate_update(binary_protocol::OP_DEL, key, "", timestamp);
+            break;
+        }
+        case binary_protocol::OP_GET_ALL:
+            reply.stream = stream_all_keys();
+            return true;
+        case binary_protocol::OP_MERKLE_ROOT: {
+            auto index = merkle_index();
+            merkle::Hash root = index ? index->get_root_hash() : merkle::Hash();
+            reply.body.assign(reinterpret_cast<const char*>(root.bytes), sizeof(root.bytes));
+            binary_protocol::append_u64(reply.body, anti_entropy_manager_ ? anti_entropy_manager_->safe_point() : 0);
+            break;
+        }
+        case binary_protocol::OP_MERKLE_LEVEL: {
+            auto index = merkle_index();
+            auto ids = parse_u32_list(request.value);
+            if (!index || ids.empty()) {
+                status = binary_protocol::STATUS_ERROR;
+                break;
+            }
+            size_t level = std::min<size_t>(ids.front(), index->depth());
+            size_t span = std::min(AntiEntropyManager::fan_out_bits, index->depth() - level);
+            std::vector<size_t> nodes(ids.begin() + 1, ids.end());
+            for (const auto& hash : index->get_subtree_hashes(level, nodes, span)) {
+                reply.body.append(reinterpret_cast<const char*>(hash.bytes), sizeof(hash.bytes));
+            }
+            break;
+        }
+        case binary_protocol::OP_GET_BUCKETS: {
+            auto index = merkle_index();
+            if (!index) {
+                status = binary_protocol::STATUS_ERROR;
+                break;
+            }
+            auto ids = parse_u32_list(request.value);
+            reply.stream = stream_bucket_entries(std::move(index), std::vector<size_t>(ids.begin(), ids.end()));
+            return true;
+        }
+        case binary_protocol::OP_GET_ENTRIES: {
+            std::vector<std::string> keys;
+            if (!binary_protocol::for_each_key(request.value, [&](std::string_view k) { keys.emplace_back(k); })) {
+                status = binary_protocol::STATUS_ERROR;
+                break;
+            }
+            reply.stream = stream_entries(std::move(keys));
+            return true;
+        }
+        case binary_protocol::OP_GOSSIP:
+            reply.body = membership_->handle_gossip(request.value);
+            break;
+        case binary_protocol::OP_TRANSFER: {
+            auto index = merkle_index();
+            auto ids = parse_u32_list(request.value);
+            if (!index || ids.size() != 1 || ids.front() >= HashRing::partitions) {
+                status = binary_protocol::STATUS_ERROR;
+                break;
+            }
+            reply.stream = stream_partition(std::move(index), ids.front());
+            return true;
+        }
+        }
+
+        binary_protocol::encode_response_header(reply.header.data(), status, static_cast<uint32_t>(reply.payload().size()));
+        return !(request.flags & binary_protocol::FLAG_QUIET);
+    }
+
+    // Hands a local write to the replication senders of the key's other owners, which
+    // batch and coalesce it
+    void propagate_update(binary_protocol::Opcode opcode, const std::string& key,
+                          const std::string& value, uint64_t timestamp, uint64_t expire_at = 0) {
+        std::shared_lock<std::shared_mutex> lock(peers_mutex_);
+        for (auto* sender : replicas_[HashRing::partition_of(key)]) {
+            sender->enqueue(opcode, key, value, timestamp, expire_at);
         }
     }
 
+    // Whether the key's partition is one this node holds. Keyed requests for any other
+    // partition are answered with MOVED and the partition's primary.
+    bool owns(std::string_view key) const {
+        return owned_[HashRing::partition_of(key)].load(std::memory_order_relaxed);
+    }
+
 private:
-    std::unique_ptr<AntiEntropyManager> anti_entropy_manager_;
+    struct Peer {
+        ClusterConfig::Address address;
+        std::unique_ptr<ReplicationSender> sender;
+        bool live = false;
+    };
 
-    uint64_t current_timestamp() {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()
-        ).count();
+    Node(const std::vector<boost::asio::io_context*>& contexts, bool reuse_port, const ClusterConfig& config,
+         size_t shard_count);
+
+    // The two-node setup of the original constructors: the peer is the only seed
+    static ClusterConfig pair_config(short port, const std::string& peer_host, short peer_port);
+
+    // Membership listener: a member's sender is created when it joins and paused while it is
+    // dead, and the ring is rebuilt over the members that are not
+    void on_member_change(const Membership::Member& member);
+    // Called with peers_mutex_ held exclusively
+    void rebuild_ring();
+
+    std::string primary_of(std::string_view key) const {
+        std::shared_lock<std::shared_mutex> lock(peers_mutex_);
+        const auto& owners = ring_->owners(HashRing::partition_of(key));
+        return owners.empty() ? std::string() : owners.front().to_string();
+    }
+
+    // After a local write was not applied: whether the key holds a newer write, one that
+    // arrived between stamping this write and storing it
+    bool superseded(std::string_view key, uint64_t timestamp) const {
+        return kv_store_.get_entry(key).timestamp > timestamp;
     }
 
-    void parse_keys_with_timestamps(const std::string& data, std::unordered_map<std::string, uint64_t>& out_map) {
-        // Simple parsing assuming format: key1:timestamp1;key2:timestamp2;...
-        size_t start = 0;
-        while (start < data.size()) {
-            size_t sep = data.find(':', start);
-            if (sep == std::string::npos) break;
-            std::string key = data.substr(start, sep - start);
-            size_t end = data.find(';', sep);
-            std::string ts_str = (end == std::string::npos) ? data.substr(sep + 1) : data.substr(sep + 1, end - sep - 1);
-            uint64_t ts = std::stoull(ts_str);
-            out_map[key] = ts;
-            if (end == std::string::npos) break;
-            start = end + 1;
+    static bool is_keyed(text_protocol::Command command) {
+        return command == text_protocol::Command::GET || command == text_protocol::Command::SET ||
+               command == text_protocol::Command::DEL || command == text_protocol::Command::EXPIRE;
+    }
+
+    static std::unique_ptr<tcp::acceptor> open_acceptor(boost::asio::io_context& io_context,
+                                                        short port, bool reuse_port);
+
+    std::shared_ptr<IndexInterface> merkle_index() const {
+        return anti_entropy_manager_ ? anti_entropy_manager_->get_merkle_index() : nullptr;
+    }
+
+    // Streams every key and timestamp, one shard at a time, in chunks of about kStreamChunkSize
+    std::function<bool(std::string&)> stream_all_keys() {
+        auto pending = std::make_shared<std::vector<std::pair<std::string, uint64_t>>>();
+        auto next_shard = std::make_shared<size_t>(0);
+        auto position = std::make_shared<size_t>(0);
+        return [this, pending, next_shard, position](std::string& chunk) {
+            while (chunk.size() < binary_protocol::kStreamChunkSize) {
+                if (*position == pending->size()) {
+                    if (*next_shard == kv_store_.shard_count()) return false;
+                    *pending = kv_store_.get_shard_keys_with_timestamps((*next_shard)++);
+                    *position = 0;
+                    continue;
+                }
+                const auto& [key, ts] = (*pending)[(*position)++];
+                binary_protocol::append_key_timestamp(chunk, key, ts);
+            }
+            return *position < pending->size() || *next_shard < kv_store_.shard_count();
+        };
+    }
+
+    // Streams the entries of the listed buckets, a batch of buckets per chunk
+    static std::function<bool(std::string&)> stream_bucket_entries(std::shared_ptr<IndexInterface> index,
+                                                                   std::vector<size_t> buckets) {
+        auto position = std::make_shared<size_t>(0);
+        return [index, buckets = std::move(buckets), position](std::string& chunk) {
+            while (chunk.size() < binary_protocol::kStreamChunkSize && *position < buckets.size()) {
+                for (const auto& entry : index->get_bucket_entries({buckets[(*position)++]})) {
+                    binary_protocol::append_bucket_entry(chunk, entry.key, entry.timestamp, entry.digest);
+                }
+            }
+            return *position < buckets.size();
+        };
+    }
+
+    // Streams the value, write timestamp and TTL of each listed key that is present, or
+    // its tombstone
+    std::function<bool(std::string&)> stream_entries(std::vector<std::string> keys) {
+        auto position = std::make_shared<size_t>(0);
+        return [this, keys = std::move(keys), position](std::string& chunk) {
+            while (chunk.size() < binary_protocol::kStreamChunkSize && *position < keys.size()) {
+                const auto& key = keys[(*position)++];
+                auto stored = kv_store_.get_entry(key);
+                if (stored.timestamp != 0) {
+                    binary_protocol::append_entry(chunk, key, stored.timestamp, stored.value.view(), stored.expire_at,
+                                                  stored.tombstone ? binary_protocol::ENTRY_TOMBSTONE : 0);
+                }
+            }
+            return *position < keys.size();
+        };
+    }
+
+    // Streams a partition to a node that has gained it: every entry this node holds, a
+    // Merkle bucket at a time, then the entries of the keys written since the transfer
+    // began, until a pass finds none. A partition written faster than it can be sent
+    // would never finish, so the catch-up passes are bounded: replication reaches the new
+    // owner once its ring includes it, and anti-entropy repairs the rest.
+    std::function<bool(std::string&)> stream_partition(std::shared_ptr<IndexInterface> index, size_t partition) {
+        // Opened before the first bucket is read, so every write the copy misses is recorded
+        auto capture = kv_store_.change_log().open([partition](std::string_view key) {
+            return HashRing::partition_of(key) == partition;
+        });
+        size_t shift = index->depth() - HashRing::partition_bits;
+        size_t end = (partition + 1) << shift;
+        auto next_bucket = std::make_shared<size_t>(partition << shift);
+        auto keys = std::make_shared<std::vector<std::string>>();
+        auto position = std::make_shared<size_t>(0);
+        auto passes = std::make_shared<size_t>(0);
+        return [this, index, capture, partition, end, next_bucket, keys, position, passes](std::string& chunk) {
+            while (chunk.size() < binary_protocol::kStreamChunkSize) {
+                if (*position == keys->size()) {
+                    keys->clear();
+                    *position = 0;
+                    if (*next_bucket < end) {
+                        for (auto& entry : index->get_bucket_entries({(*next_bucket)++})) {
+                            keys->push_back(std::move(entry.key));
+                        }
+                    } else if (++*passes > max_catch_up_passes || (*keys = capture->drain()).empty()) {
+                        if (capture->overflowed()) {
+                            KV_LOG_WARN("Transfer of partition " << partition
+                                        << " recorded too many writes; anti-entropy will finish it");
+                        }
+                        return false;
+                    }
+                    continue;
+                }
+                const auto& key = (*keys)[(*position)++];
+                auto stored = kv_store_.get_entry(key);
+                if (stored.timestamp != 0) {
+                    binary_protocol::append_entry(chunk, key, stored.timestamp, stored.value.view(), stored.expire_at,
+                                                  stored.tombstone ? binary_protocol::ENTRY_TOMBSTONE : 0);
+                }
+            }
+            return true;
+        };
+    }
+
+    static std::vector<uint32_t> parse_u32_list(std::string_view bytes) {
+        std::vector<uint32_t> values;
+        values.reserve(bytes.size() / 4);
+        for (size_t pos = 0; pos + 4 <= bytes.size(); pos += 4) {
+            values.push_back(binary_protocol::load_u32(bytes.data() + pos));
         }
+        return values;
     }
 
-    void fetch_and_update_key(const std::string& key) {
-        try {
-            tcp::socket socket(acceptor_.get_executor());
-            tcp::resolver resolver(acceptor_.get_executor());
-            boost::asio::connect(socket, resolver.resolve(peer_host_, std::to_string(peer_port_)));
+    std::unique_ptr<AntiEntropyManager> anti_entropy_manager_;
+    std::unique_ptr<PersistenceManager> persistence_manager_;
 
-            std::string request = "GET " + key;
-            boost::asio::write(socket, boost::asio::buffer(request));
+    uint64_t current_timestamp() {
+        return kv_store_.clock().now();
+    }
 
-            char data[1024];
-            size_t length = socket.read_some(boost::asio::buffer(data));
-            std::string value(data, length);
+    // Parses "n;n;...", skipping items that are not numbers
+    static std::vector<size_t> parse_index_list(std::string_view list) {
+        std::vector<size_t> indices;
+        text_protocol::for_each_item(list, [&](std::string_view item) {
+            uint64_t index;
+            if (text_protocol::parse_uint(item, index)) indices.push_back(static_cast<size_t>(index));
+        });
+        return indices;
+    }
 
-            // For simplicity, assume value does not contain timestamp; set with current time
-            uint64_t timestamp = current_timestamp();
-            kv_store_.set(key, value, timestamp);
-        } catch (std::exception& e) {
-            std::cerr << "Failed to fetch and update key " << key << ": " << e.what() << "\n";
+    // Pulls the peer's versions of these keys and merges them with their original timestamps
+    void fetch_and_merge_keys(tcp::socket& socket, FrameReader& reader, const std::vector<std::string>& keys) {
+        std::string key_list;
+        for (const auto& key : keys) {
+            binary_protocol::append_key(key_list, key);
         }
+        std::string frame;
+        binary_protocol::encode_request(frame, binary_protocol::OP_GET_ENTRIES, "", key_list);
+        boost::asio::write(socket, boost::asio::buffer(frame));
+        reader.read_stream([this](std::string_view chunk) {
+            return binary_protocol::for_each_entry(chunk, [this](const binary_protocol::EntryRecord& record) {
+                std::string key(record.key);
+                if (record.tombstone()) {
+                    kv_store_.merge_tombstone(key, record.timestamp);
+                } else {
+                    kv_store_.merge(key, std::string(record.value), record.timestamp, record.expire_at);
+                }
+            });
+        });
     }
-    
-    void fetch_and_update_all_keys() {
-        try {
-            tcp::socket socket(acceptor_.get_executor());
-            tcp::resolver resolver(acceptor_.get_executor());
-            boost::asio::connect(socket, resolver.resolve(peer_host_, std::to_string(peer_port_)));
 
-            std::string request = "GET ALL";
-            boost::asio::write(socket, boost::asio::buffer(request));
+    void fetch_and_update_key(const ClusterConfig::Address& peer, const std::string& key) {
+        try {
+            tcp::socket socket(io_context_);
+            connect_binary(socket, peer.host, peer.port);
+            FrameReader reader(socket);
+            fetch_and_merge_keys(socket, reader, {key});
+        } catch (std::exception& e) {
+            KV_LOG_WARN("Failed to fetch and update key " << key << ": " << e.what());
+        }
+    }
 
-            char data[1024];
-            size_t length = socket.read_some(boost::asio::buffer(data));
-            std::string response(data, length);
+    // Streams the peer's key list and pulls the keys it has newer, one chunk at a time,
+    // over a second connection so the stream never has to be held in memory
+    void fetch_and_update_all_keys(const ClusterConfig::Address& peer) {
+        try {
+            tcp::socket list_socket(io_context_);
+            tcp::socket get_socket(io_context_);
+            connect_binary(list_socket, peer.host, peer.port);
+            connect_binary(get_socket, peer.host, peer.port);
+            FrameReader list_reader(list_socket);
+            FrameReader get_reader(get_socket);
 
-            std::unordered_map<std::string, uint64_t> keys_with_timestamps;
-            parse_keys_with_timestamps(response, keys_with_timestamps);
+            std::string frame;
+            binary_protocol::encode_request(frame, binary_protocol::OP_GET_ALL, "");
+            boost::asio::write(list_socket, boost::asio::buffer(frame));
 
-            for (const auto& kv : keys_with_timestamps) {
-                fetch_and_update_key(kv.first);
-            }
+            list_reader.read_stream([&](std::string_view chunk) {
+                std::vector<std::string> keys;
+                bool valid = binary_protocol::for_each_key_timestamp(chunk, [&](std::string_view key, uint64_t ts) {
+                    // Equal timestamps are pulled too; merge settles the tie by value
+                    if (kv_store_.get_ref(key).timestamp <= ts) {
+                        keys.emplace_back(key);
+                    }
+                });
+                if (valid && !keys.empty()) {
+                    fetch_and_merge_keys(get_socket, get_reader, keys);
+                }
+                return valid;
+            });
         } catch (std::exception& e) {
-            std::cerr << "Failed to fetch and update all keys: " << e.what() << "\n";
+            KV_LOG_WARN("Failed to fetch and update all keys: " << e.what());
         }
     }
 
     void send_update_to_peer(const std::string& key) {
         try {
-            auto val_ts = kv_store_.get_value_with_timestamp(key);
-            std::string command = "PROPAGATE SET " + key + " " + val_ts.value + " " + std::to_string(val_ts.timestamp);
-            propagate_update(command);
+            auto stored = kv_store_.get_ref(key);
+            propagate_update(binary_protocol::OP_SET, key, stored.value.str(), stored.timestamp, stored.expire_at);
         } catch (std::exception& e) {
-            std::cerr << "Failed to send update to peer for key " << key << ": " << e.what() << "\n";
+            KV_LOG_WARN("Failed to send update to peer for key " << key << ": " << e.what());
         }
     }
 
-    tcp::acceptor acceptor_;
+    boost::asio::io_context& io_context_;  // Context for background and outgoing connections
+    std::vector<std::unique_ptr<tcp::acceptor>> acceptors_;
     KeyValueStore kv_store_;
-    std::string peer_host_;
-    short peer_port_;
+    std::unique_ptr<ExpiryReaper> expiry_reaper_;  // Declared after the store, so it stops first
+    ClusterConfig config_;
+    mutable std::shared_mutex peers_mutex_;  // Guards the peers, the ring and the replica lists
+    std::unordered_map<std::string, Peer> peers_;  // By member address
+    std::shared_ptr<const HashRing> ring_;  // Over this node and the live members
+    std::vector<std::vector<ReplicationSender*>> replicas_;  // Per partition, the other owners' senders
+    std::array<std::atomic<bool>, HashRing::partitions> owned_{};  // Per partition, read without the lock
+    std::unique_ptr<Membership> membership_;  // Declared after the peers, so its listener stops first
 };
 
 void start_accept();
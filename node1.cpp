@@ -1,21 +1,39 @@
 #include "node.hpp"
 #include "anti_entropy/anti_entropy_manager.hpp"
 #include <boost/asio.hpp>
-#include <iostream>
+#include <algorithm>
+#include "logging/logger.hpp"
+#include <stdexcept>
+#include <string>
+#include <thread>
 
-int main() {
+// Usage: node1 [io_threads] [per_core|shared] [maxmemory, e.g. 256m; 0 = no cap] [lru|lfu|random]
+int main(int argc, char* argv[]) {
     try {
-        std::cout << "main() started" << std::endl;
-        boost::asio::io_context io_context;
-        std::cout << "io_context created" << std::endl;
-        Node node(io_context, 5008, "127.0.0.1", 5009);
-        std::cout << "Node created" << std::endl;
+        KV_LOG_INFO("main() started");
+        size_t io_threads = argc > 1 ? std::stoul(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+        auto mode = argc > 2 && std::string(argv[2]) == "shared" ? IoContextPool::SHARED : IoContextPool::PER_CORE;
+        IoContextPool pool(io_threads, mode);
+        KV_LOG_INFO("I/O pool created with " << pool.thread_count() << " threads ("
+                    << (pool.mode() == IoContextPool::SHARED ? "shared" : "per-core") << ")");
+        Node node(pool, 5008, "127.0.0.1", 5009);
+        KV_LOG_INFO("Node created");
+        size_t max_memory = 0;
+        EvictionPolicy policy = EvictionPolicy::LRU;
+        if (argc > 3 && !eviction::parse_max_memory(argv[3], max_memory)) {
+            throw std::invalid_argument(std::string("invalid maxmemory: ") + argv[3]);
+        }
+        if (argc > 4 && !eviction::parse_policy(argv[4], policy)) {
+            throw std::invalid_argument(std::string("invalid eviction policy: ") + argv[4]);
+        }
+        node.set_max_memory(max_memory, policy);
+        node.enable_persistence("node1_data");
         node.start_anti_entropy();
-        std::cout << "Started anti-entropy" << std::endl;
-        std::cout << "About to run io_context" << std::endl;
-        io_context.run();
+        KV_LOG_INFO("Started anti-entropy");
+        KV_LOG_INFO("About to run I/O pool");
+        pool.run();
     } catch (std::exception& e) {
-        std::cerr << "Exception: " << e.what() << "\n";
+        KV_LOG_ERROR("Exception: " << e.what());
     }
     return 0;
 }
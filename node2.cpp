@@ -1,16 +1,33 @@
 #include "node.hpp"
 #include "anti_entropy/anti_entropy_manager.hpp"
 #include <boost/asio.hpp>
-#include <iostream>
+#include <algorithm>
+#include "logging/logger.hpp"
+#include <stdexcept>
+#include <string>
+#include <thread>
 
-int main() {
+// Usage: node2 [io_threads] [per_core|shared] [maxmemory, e.g. 256m; 0 = no cap] [lru|lfu|random]
+int main(int argc, char* argv[]) {
     try {
-        boost::asio::io_context io_context;
-        Node node(io_context, 5009, "127.0.0.1", 5008);
+        size_t io_threads = argc > 1 ? std::stoul(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+        auto mode = argc > 2 && std::string(argv[2]) == "shared" ? IoContextPool::SHARED : IoContextPool::PER_CORE;
+        IoContextPool pool(io_threads, mode);
+        Node node(pool, 5009, "127.0.0.1", 5008);
+        size_t max_memory = 0;
+        EvictionPolicy policy = EvictionPolicy::LRU;
+        if (argc > 3 && !eviction::parse_max_memory(argv[3], max_memory)) {
+            throw std::invalid_argument(std::string("invalid maxmemory: ") + argv[3]);
+        }
+        if (argc > 4 && !eviction::parse_policy(argv[4], policy)) {
+            throw std::invalid_argument(std::string("invalid eviction policy: ") + argv[4]);
+        }
+        node.set_max_memory(max_memory, policy);
+        node.enable_persistence("node2_data");
         node.start_anti_entropy();
-        io_context.run();
+        pool.run();
     } catch (std::exception& e) {
-        std::cerr << "Exception: " << e.what() << "\n";
+        KV_LOG_ERROR("Exception: " << e.what());
     }
     return 0;
 }
@@ -0,0 +1,126 @@
+#include "persistence_manager.hpp"
+#include "snapshot.hpp"
+#include "kv_store.hpp"
+#include <filesystem>
+#include <stdexcept>
+#include "logging/logger.hpp"
+
+PersistenceManager::PersistenceManager(const std::string& directory, KeyValueStore& kv_store, Options options)
+    : directory_(directory), kv_store_(kv_store), options_(options) {}
+
+PersistenceManager::~PersistenceManager() {
+    stop();
+}
+
+void PersistenceManager::recover() {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t first_segment = 0;
+    size_t loaded = 0;
+    bool skipped = false;
+
+    for (const auto& [wal_segment, path] : Snapshot::list(directory_)) {
+        try {
+            loaded = Snapshot::load(path, options_.recovery_threads,
+                [this](const std::string& key, const std::string& value, uint64_t timestamp,
+                       uint64_t expire_at, bool tombstone) {
+                    if (tombstone) {
+                        kv_store_.restore_tombstone(key, timestamp);
+                    } else {
+                        kv_store_.restore(key, value, timestamp, expire_at);
+                    }
+                });
+            first_segment = wal_segment;
+            KV_LOG_INFO("Loaded " << loaded << " keys from " << path);
+            break;
+        } catch (const std::exception& e) {
+            // take_snapshot keeps the previous snapshot and the segments from it on, so
+            // the next one down can stand in, provided those segments are all there
+            KV_LOG_WARN("Skipping snapshot " << path << ": " << e.what());
+            skipped = true;
+        }
+    }
+    if (skipped && !WriteAheadLog::complete_from(directory_, first_segment)) {
+        throw std::runtime_error("no readable snapshot in " + directory_ +
+                                 " has the log segments after it; refusing to start with data missing");
+    }
+
+    // Replay is idempotent under last-write-wins, so records already in the snapshot are harmless
+    size_t replayed = WriteAheadLog::replay(directory_, [this](const WriteAheadLog::Record& record) {
+        if (record.type == WriteAheadLog::RECORD_SET || record.type == WriteAheadLog::RECORD_SET_TTL) {
+            kv_store_.restore(record.key, record.value, record.timestamp, record.expire_at);
+        } else {
+            kv_store_.restore_tombstone(record.key, record.timestamp);
+        }
+    }, first_segment);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    KV_LOG_INFO("Recovered " << loaded << " snapshot keys and " << replayed << " log records from "
+                << directory_ << " in " << elapsed.count() << " ms");
+}
+
+void PersistenceManager::start() {
+    write_ahead_log_ = std::make_shared<WriteAheadLog>(directory_, options_.wal);
+    write_ahead_log_->open();
+    kv_store_.set_write_ahead_log(write_ahead_log_);
+    stopping_ = false;
+    snapshot_thread_ = std::thread([this]() { run(); });
+}
+
+void PersistenceManager::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (snapshot_thread_.joinable()) {
+        snapshot_thread_.join();
+    }
+    if (write_ahead_log_) {
+        kv_store_.set_write_ahead_log(nullptr);
+        write_ahead_log_->close();
+        write_ahead_log_.reset();
+    }
+}
+
+void PersistenceManager::take_snapshot() {
+    // Writes applied before the rotation are already in the store, so the snapshot
+    // (taken afterwards) contains them; everything later is in the new segment.
+    uint64_t segment = write_ahead_log_->rotate();
+    std::string path = Snapshot::write(directory_, segment, kv_store_);
+    // Read it back before anything it supersedes goes; load throws if it is corrupt
+    Snapshot::load(path, options_.recovery_threads,
+                   [](const std::string&, const std::string&, uint64_t, uint64_t, bool) {});
+
+    // The previous snapshot and the segments from it on stay as well, so recovery still
+    // has a complete fallback if the new one is damaged on disk later. With no previous
+    // snapshot the fallback is the whole log.
+    auto snapshots = Snapshot::list(directory_);
+    uint64_t keep_from = 0;
+    for (const auto& [old_segment, old_path] : snapshots) {
+        if (old_segment < segment) {
+            keep_from = old_segment;
+            break;
+        }
+    }
+    write_ahead_log_->remove_segments_before(keep_from);
+    for (const auto& [old_segment, old_path] : snapshots) {
+        if (old_segment < keep_from) {
+            std::error_code ec;
+            std::filesystem::remove(old_path, ec);
+        }
+    }
+    KV_LOG_INFO("Wrote snapshot " << path);
+}
+
+void PersistenceManager::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, options_.snapshot_interval, [this]() { return stopping_; })) {
+        lock.unlock();
+        try {
+            take_snapshot();
+        } catch (const std::exception& e) {
+            KV_LOG_ERROR("Snapshot failed: " << e.what());
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef PERSISTENCE_MANAGER_HPP
+#define PERSISTENCE_MANAGER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "write_ahead_log.hpp"
+
+class KeyValueStore;
+
+// Owns a node's data directory: recovers the store from the newest snapshot plus
+// the write-ahead log written after it, then keeps logging writes and takes a
+// snapshot periodically so the log that must be replayed stays short.
+class PersistenceManager {
+public:
+    struct Options {
+        WriteAheadLog::Options wal;
+        std::chrono::milliseconds snapshot_interval{300000};
+        size_t recovery_threads = std::max(1u, std::thread::hardware_concurrency());
+    };
+
+    PersistenceManager(const std::string& directory, KeyValueStore& kv_store, Options options);
+    ~PersistenceManager();
+
+    // Loads the newest readable snapshot and replays only the log segments after it.
+    // Throws if no readable snapshot has all of its segments, rather than start with
+    // data missing.
+    void recover();
+
+    // Attaches a new log segment to the store and starts periodic snapshots
+    void start();
+    void stop();
+
+    // Rotates the log, writes and verifies a snapshot from the new segment on, and
+    // drops all but it and the previous snapshot with their segments
+    void take_snapshot();
+
+private:
+    void run();
+
+    std::string directory_;
+    KeyValueStore& kv_store_;
+    Options options_;
+    std::shared_ptr<WriteAheadLog> write_ahead_log_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::thread snapshot_thread_;
+};
+
+#endif // PERSISTENCE_MANAGER_HPP
@@ -0,0 +1,251 @@
+#include "snapshot.hpp"
+#include "kv_store.hpp"
+#include <boost/crc.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'K', 'V', 'S', 'N', 'A', 'P', '0', '2'};
+constexpr char kMagicV1[8] = {'K', 'V', 'S', 'N', 'A', 'P', '0', '1'};
+constexpr size_t kHeaderSize = 20;          // magic + wal segment + section count
+constexpr size_t kSectionEntrySize = 28;    // offset + length + record count + crc
+constexpr size_t kRecordHeaderSize = 25;    // key length + value length + timestamp + expire_at + flags
+constexpr size_t kRecordHeaderSizeV1 = 16;  // key length + value length + timestamp
+constexpr uint8_t kFlagTombstone = 0x01;
+
+void put_u32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; i++, v >>= 8) out.push_back(static_cast<char>(v & 0xff));
+}
+
+void put_u64(std::string& out, uint64_t v) {
+    for (int i = 0; i < 8; i++, v >>= 8) out.push_back(static_cast<char>(v & 0xff));
+}
+
+uint32_t get_u32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | static_cast<uint8_t>(p[i]);
+    return v;
+}
+
+uint64_t get_u64(const char* p) {
+    return (uint64_t(get_u32(p + 4)) << 32) | get_u32(p);
+}
+
+uint32_t crc32(const char* data, size_t size) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+void write_fully(int fd, const std::string& data, off_t offset) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = ::pwrite(fd, data.data() + done, data.size() - done, offset + static_cast<off_t>(done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("snapshot write failed: ") + std::strerror(errno));
+        }
+        done += static_cast<size_t>(n);
+    }
+}
+
+std::string snapshot_name(uint64_t wal_segment) {
+    char name[40];
+    std::snprintf(name, sizeof(name), "snapshot-%06llu.snap", static_cast<unsigned long long>(wal_segment));
+    return name;
+}
+
+struct Section {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t records;
+    uint32_t crc;
+};
+
+} // namespace
+
+std::string Snapshot::write(const std::string& directory, uint64_t wal_segment, const KeyValueStore& kv_store) {
+    std::filesystem::create_directories(directory);
+    std::string path = (std::filesystem::path(directory) / snapshot_name(wal_segment)).string();
+    std::string tmp_path = path + ".tmp";
+
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("cannot create " + tmp_path + ": " + std::strerror(errno));
+    }
+    try {
+        size_t shard_count = kv_store.shard_count();
+        std::vector<Section> sections;
+        uint64_t offset = kHeaderSize + kSectionEntrySize * shard_count;
+        std::string buffer;
+
+        for (size_t shard = 0; shard < shard_count; shard++) {
+            // Only this shard is locked, and only for the in-memory copy
+            auto entries = kv_store.copy_shard(shard);
+            buffer.clear();
+            for (const auto& [key, stored] : entries) {
+                put_u32(buffer, static_cast<uint32_t>(key.size()));
+                put_u32(buffer, static_cast<uint32_t>(stored.value.size()));
+                put_u64(buffer, stored.timestamp);
+                put_u64(buffer, stored.expire_at);
+                buffer.push_back(static_cast<char>(stored.tombstone ? kFlagTombstone : 0));
+                buffer.append(key);
+                buffer.append(stored.value.view());
+            }
+            write_fully(fd, buffer, static_cast<off_t>(offset));
+            sections.push_back({offset, buffer.size(), entries.size(), crc32(buffer.data(), buffer.size())});
+            offset += buffer.size();
+        }
+
+        std::string header(kMagic, sizeof(kMagic));
+        put_u64(header, wal_segment);
+        put_u32(header, static_cast<uint32_t>(sections.size()));
+        for (const auto& section : sections) {
+            put_u64(header, section.offset);
+            put_u64(header, section.length);
+            put_u64(header, section.records);
+            put_u32(header, section.crc);
+        }
+        write_fully(fd, header, 0);
+        if (::fsync(fd) != 0) {
+            throw std::runtime_error(std::string("snapshot fsync failed: ") + std::strerror(errno));
+        }
+    } catch (...) {
+        ::close(fd);
+        std::filesystem::remove(tmp_path);
+        throw;
+    }
+    ::close(fd);
+    std::filesystem::rename(tmp_path, path);
+
+    // Make the rename itself durable
+    int dir_fd = ::open(directory.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+    return path;
+}
+
+size_t Snapshot::load(const std::string& path, size_t threads, const ApplyFn& apply) {
+    std::ifstream in(path, std::ios::binary);
+    char header[kHeaderSize];
+    if (!in.read(header, kHeaderSize) || (std::memcmp(header, kMagic, sizeof(kMagic)) != 0 &&
+                                          std::memcmp(header, kMagicV1, sizeof(kMagicV1)) != 0)) {
+        throw std::runtime_error("not a snapshot file: " + path);
+    }
+    // Version 1 records have no expiry time or flags
+    size_t record_header_size = std::memcmp(header, kMagic, sizeof(kMagic)) == 0 ? kRecordHeaderSize
+                                                                                 : kRecordHeaderSizeV1;
+    // The table is not covered by a checksum, so nothing it says is sized or read before
+    // it has been checked against the file
+    std::error_code ec;
+    uint64_t file_size = std::filesystem::file_size(path, ec);
+    uint32_t section_count = get_u32(header + 16);
+    if (ec || uint64_t(section_count) * kSectionEntrySize > file_size - kHeaderSize) {
+        throw std::runtime_error("truncated snapshot header: " + path);
+    }
+    std::string table(kSectionEntrySize * section_count, '\0');
+    if (!in.read(&table[0], table.size())) {
+        throw std::runtime_error("truncated snapshot header: " + path);
+    }
+    std::vector<Section> sections;
+    for (uint32_t i = 0; i < section_count; i++) {
+        const char* entry = table.data() + i * kSectionEntrySize;
+        Section section{get_u64(entry), get_u64(entry + 8), get_u64(entry + 16), get_u32(entry + 24)};
+        if (section.offset > file_size || section.length > file_size - section.offset) {
+            throw std::runtime_error("corrupt snapshot section table in " + path);
+        }
+        sections.push_back(section);
+    }
+
+    // Workers claim sections one at a time; each reads through its own stream
+    std::atomic<size_t> next_section{0};
+    std::atomic<size_t> loaded{0};
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+
+    auto worker = [&]() {
+        try {
+            std::ifstream section_in(path, std::ios::binary);
+            std::string data;
+            for (size_t i = next_section++; i < sections.size(); i = next_section++) {
+                const Section& section = sections[i];
+                data.resize(section.length);
+                section_in.seekg(static_cast<std::streamoff>(section.offset));
+                if (!section_in.read(&data[0], section.length) || crc32(data.data(), data.size()) != section.crc) {
+                    throw std::runtime_error("corrupt snapshot section " + std::to_string(i) + " in " + path);
+                }
+                size_t pos = 0;
+                std::string key, value;
+                for (uint64_t r = 0; r < section.records; r++) {
+                    if (pos + record_header_size > data.size()) {
+                        throw std::runtime_error("malformed snapshot section " + std::to_string(i) + " in " + path);
+                    }
+                    uint32_t key_len = get_u32(data.data() + pos);
+                    uint32_t value_len = get_u32(data.data() + pos + 4);
+                    uint64_t timestamp = get_u64(data.data() + pos + 8);
+                    uint64_t expire_at = 0;
+                    bool tombstone = false;
+                    if (record_header_size == kRecordHeaderSize) {
+                        expire_at = get_u64(data.data() + pos + 16);
+                        tombstone = static_cast<uint8_t>(data[pos + 24]) & kFlagTombstone;
+                    }
+                    pos += record_header_size;
+                    if (pos + uint64_t(key_len) + value_len > data.size()) {
+                        throw std::runtime_error("malformed snapshot section " + std::to_string(i) + " in " + path);
+                    }
+                    key.assign(data.data() + pos, key_len);
+                    value.assign(data.data() + pos + key_len, value_len);
+                    pos += key_len + value_len;
+                    apply(key, value, timestamp, expire_at, tombstone);
+                }
+                loaded += section.records;
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failure_mutex);
+            if (!failure) failure = std::current_exception();
+            next_section = sections.size();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    size_t worker_count = std::max<size_t>(1, std::min(threads, sections.size()));
+    for (size_t i = 0; i < worker_count; i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    return loaded;
+}
+
+std::vector<std::pair<uint64_t, std::string>> Snapshot::list(const std::string& directory) {
+    std::vector<std::pair<uint64_t, std::string>> snapshots;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > 14 && name.compare(0, 9, "snapshot-") == 0 && name.compare(name.size() - 5, 5, ".snap") == 0) {
+            try {
+                snapshots.emplace_back(std::stoull(name.substr(9, name.size() - 14)), entry.path().string());
+            } catch (const std::exception&) {
+                // Not one of ours
+            }
+        }
+    }
+    std::sort(snapshots.rbegin(), snapshots.rend());
+    return snapshots;
+}
@@ -0,0 +1,40 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class KeyValueStore;
+
+// Binary point-in-time image of a KeyValueStore (snapshot-NNNNNN.snap).
+//
+// The number is the write-ahead log segment that recovery replays from. The file
+// holds one section per store shard, so writers are only held off the shard
+// currently being copied, and recovery can load sections on several threads.
+//
+// Layout (little-endian):
+//   magic "KVSNAP02", u64 wal_segment, u32 section_count,
+//   section_count x { u64 offset, u64 length, u64 record_count, u32 crc32 },
+//   sections of records { u32 key_len, u32 value_len, u64 timestamp, u64 expire_at,
+//                         u8 flags (1: tombstone), key, value }
+// "KVSNAP01" files, whose records stop at the timestamp, still load.
+class Snapshot {
+public:
+    using ApplyFn = std::function<void(const std::string& key, const std::string& value, uint64_t timestamp,
+                                       uint64_t expire_at, bool tombstone)>;
+
+    // Writes a snapshot of kv_store to directory atomically (temp file + rename)
+    // and returns its path.
+    static std::string write(const std::string& directory, uint64_t wal_segment, const KeyValueStore& kv_store);
+
+    // Loads a snapshot with up to threads workers calling apply concurrently. Returns
+    // the number of records, or throws if the file or a section is corrupt.
+    static size_t load(const std::string& path, size_t threads, const ApplyFn& apply);
+
+    // Snapshots in directory as (wal_segment, path), newest first
+    static std::vector<std::pair<uint64_t, std::string>> list(const std::string& directory);
+};
+
+#endif // SNAPSHOT_HPP
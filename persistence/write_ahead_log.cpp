@@ -0,0 +1,357 @@
+#include "write_ahead_log.hpp"
+#include <boost/crc.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "logging/logger.hpp"
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kRecordHeaderSize = 8;       // body length + CRC
+constexpr size_t kRecordBodyHeaderSize = 17;  // type + timestamp + key length + value length
+
+void put_u32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; i++, v >>= 8) out.push_back(static_cast<char>(v & 0xff));
+}
+
+void put_u64(std::string& out, uint64_t v) {
+    for (int i = 0; i < 8; i++, v >>= 8) out.push_back(static_cast<char>(v & 0xff));
+}
+
+uint32_t get_u32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | static_cast<uint8_t>(p[i]);
+    return v;
+}
+
+uint64_t get_u64(const char* p) {
+    return (uint64_t(get_u32(p + 4)) << 32) | get_u32(p);
+}
+
+uint32_t crc32(const char* data, size_t size) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+// Segment numbers of the wal-NNNNNN.log files in a directory, ascending
+std::vector<uint64_t> list_segments(const std::string& directory) {
+    std::vector<uint64_t> segments;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > 8 && name.compare(0, 4, "wal-") == 0 && name.compare(name.size() - 4, 4, ".log") == 0) {
+            try {
+                segments.push_back(std::stoull(name.substr(4, name.size() - 8)));
+            } catch (const std::exception&) {
+                // Not one of ours
+            }
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& directory, Options options)
+    : directory_(directory), options_(options) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+std::string WriteAheadLog::segment_path(const std::string& directory, uint64_t segment) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "wal-%06llu.log", static_cast<unsigned long long>(segment));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+size_t WriteAheadLog::replay(const std::string& directory, const std::function<void(const Record&)>& apply,
+                             uint64_t first_segment) {
+    size_t applied = 0;
+    for (uint64_t segment : list_segments(directory)) {
+        if (segment < first_segment) continue;
+        std::string path = segment_path(directory, segment);
+        std::ifstream in(path, std::ios::binary);
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(path, ec);
+        uint64_t remaining = ec ? 0 : size;
+        char header[kRecordHeaderSize];
+        std::string body;
+        while (remaining >= kRecordHeaderSize && in.read(header, kRecordHeaderSize)) {
+            remaining -= kRecordHeaderSize;
+            uint32_t length = get_u32(header);
+            // The length is checked before it sizes anything: a torn header can claim up to 4 GB
+            bool fits = length >= kRecordBodyHeaderSize && length <= remaining;
+            if (fits) {
+                body.resize(length);
+                remaining -= length;
+            }
+            if (!fits || !in.read(&body[0], length) || crc32(body.data(), length) != get_u32(header + 4)) {
+                KV_LOG_WARN("WAL segment " << segment << ": torn or corrupt record after "
+                            << applied << " records, ignoring the rest of the segment");
+                break;
+            }
+            Record record;
+            record.type = static_cast<RecordType>(body[0]);
+            record.timestamp = get_u64(body.data() + 1);
+            uint32_t key_len = get_u32(body.data() + 9);
+            uint32_t value_len = get_u32(body.data() + 13);
+            size_t trailer = record.type == WriteAheadLog::RECORD_SET_TTL ? 8 : 0;
+            if (kRecordBodyHeaderSize + uint64_t(key_len) + value_len + trailer != length) {
+                KV_LOG_WARN("WAL segment " << segment << ": malformed record, ignoring the rest of the segment");
+                break;
+            }
+            record.key.assign(body.data() + kRecordBodyHeaderSize, key_len);
+            record.value.assign(body.data() + kRecordBodyHeaderSize + key_len, value_len);
+            if (trailer) {
+                record.expire_at = get_u64(body.data() + kRecordBodyHeaderSize + key_len + value_len);
+            }
+            apply(record);
+            applied++;
+        }
+    }
+    return applied;
+}
+
+void WriteAheadLog::open() {
+    std::filesystem::create_directories(directory_);
+    auto segments = list_segments(directory_);
+    open_segment(segments.empty() ? 1 : segments.back() + 1);
+    stopping_ = false;
+    flusher_thread_ = std::thread([this]() { run(); });
+}
+
+void WriteAheadLog::open_segment(uint64_t segment) {
+    std::string path = segment_path(directory_, segment);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open WAL segment " + path + ": " + std::strerror(errno));
+    }
+    fd_ = fd;
+    segment_ = segment;
+    offset_ = static_cast<uint64_t>(::lseek(fd, 0, SEEK_END));
+}
+
+void WriteAheadLog::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    flush_cv_.notify_all();
+    if (flusher_thread_.joinable()) {
+        flusher_thread_.join();
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+uint64_t WriteAheadLog::append(RecordType type, const std::string& key, const std::string& value, uint64_t timestamp,
+                               uint64_t expire_at) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (buffer_.size() >= options_.max_buffer_bytes) {
+        // The disk is falling behind; hold the writer back rather than grow without bound
+        flush_cv_.notify_one();
+        durable_cv_.wait(lock, [this]() { return buffer_.size() < options_.max_buffer_bytes || stopping_; });
+    }
+    if (failed()) {
+        throw std::runtime_error("write-ahead log failed");
+    }
+
+    size_t start = buffer_.size();
+    buffer_.append(kRecordHeaderSize, '\0');
+    buffer_.push_back(static_cast<char>(type));
+    put_u64(buffer_, timestamp);
+    put_u32(buffer_, static_cast<uint32_t>(key.size()));
+    put_u32(buffer_, static_cast<uint32_t>(value.size()));
+    buffer_.append(key);
+    buffer_.append(value);
+    if (type == RECORD_SET_TTL) {
+        put_u64(buffer_, expire_at);
+    }
+
+    uint32_t length = static_cast<uint32_t>(buffer_.size() - start - kRecordHeaderSize);
+    std::string header;
+    put_u32(header, length);
+    put_u32(header, crc32(buffer_.data() + start + kRecordHeaderSize, length));
+    buffer_.replace(start, kRecordHeaderSize, header);
+
+    uint64_t sequence = next_sequence_++;
+    if (flush_due()) {
+        flush_cv_.notify_one();
+    }
+    return sequence;
+}
+
+void WriteAheadLog::wait_durable(uint64_t sequence) {
+    if (options_.policy != SyncPolicy::PER_OPERATION) {
+        if (failed()) {
+            throw std::runtime_error("write-ahead log failed");
+        }
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    durable_cv_.wait(lock, [this, sequence]() { return durable_sequence_ >= sequence || stopping_ || failed(); });
+    if (durable_sequence_ < sequence && failed()) {
+        throw std::runtime_error("write-ahead log failed");
+    }
+}
+
+void WriteAheadLog::sync() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t target = next_sequence_ - 1;
+    sync_requested_ = std::max(sync_requested_, target);
+    flush_cv_.notify_one();
+    durable_cv_.wait(lock, [this, target]() { return durable_sequence_ >= target || stopping_ || failed(); });
+    if (durable_sequence_ < target && failed()) {
+        throw std::runtime_error("write-ahead log failed");
+    }
+}
+
+bool WriteAheadLog::flush_due() const {
+    if (stopping_ || sync_requested_ > durable_sequence_) return true;
+    switch (options_.policy) {
+    case SyncPolicy::PER_OPERATION:
+        return !buffer_.empty();
+    case SyncPolicy::BYTES:
+        return buffer_.size() >= options_.sync_bytes;
+    case SyncPolicy::INTERVAL:
+        break;
+    }
+    return buffer_.size() >= options_.max_buffer_bytes;
+}
+
+void WriteAheadLog::run() {
+    std::string batch;
+    while (true) {
+        std::unique_lock<std::mutex> io_lock(io_mutex_, std::defer_lock);
+        uint64_t target;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (options_.policy == SyncPolicy::INTERVAL) {
+                flush_cv_.wait_for(lock, std::chrono::milliseconds(options_.interval_ms),
+                                   [this]() { return flush_due(); });
+            } else {
+                flush_cv_.wait(lock, [this]() { return flush_due(); });
+            }
+            if (buffer_.empty()) {
+                if (!failed()) {
+                    durable_sequence_ = next_sequence_ - 1;
+                }
+                durable_cv_.notify_all();
+                if (stopping_) return;
+                continue;
+            }
+            // Taken in io -> state order, like rotate(), before claiming the batch
+            lock.unlock();
+            io_lock.lock();
+            lock.lock();
+            // Everything appended up to here rides on this one write + fsync
+            batch.swap(buffer_);
+            target = next_sequence_ - 1;
+        }
+        durable_cv_.notify_all();  // Buffer space is free again
+
+        // Once failed, batches are dropped: the writers waiting on them get an error
+        bool written = !failed() && write_out(batch);
+        io_lock.unlock();
+        batch.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (written) {
+                durable_sequence_ = std::max(durable_sequence_, target);
+            } else {
+                fail();
+            }
+        }
+        durable_cv_.notify_all();
+    }
+}
+
+bool WriteAheadLog::write_out(const std::string& batch) {
+    const char* data = batch.data();
+    size_t remaining = batch.size();
+    bool ok = true;
+    while (ok && remaining > 0) {
+        ssize_t written = ::write(fd_, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            KV_LOG_ERROR("WAL write failed: " << std::strerror(errno));
+            ok = false;
+            break;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    if (ok && ::fsync(fd_) != 0) {
+        KV_LOG_ERROR("WAL fsync failed: " << std::strerror(errno));
+        ok = false;
+    }
+    if (!ok) {
+        // A partial record would end replay of the segment there, losing everything
+        // written after it, so the segment goes back to its last whole batch
+        if (::ftruncate(fd_, static_cast<off_t>(offset_)) != 0 || ::fsync(fd_) != 0) {
+            KV_LOG_ERROR("WAL segment " << segment_ << " could not be cut back: " << std::strerror(errno));
+        }
+        return false;
+    }
+    offset_ += batch.size();
+    return true;
+}
+
+void WriteAheadLog::fail() {
+    if (!failed_.exchange(true, std::memory_order_acq_rel)) {
+        KV_LOG_ERROR("WAL failed; writes are refused until the node restarts");
+    }
+    buffer_.clear();
+}
+
+uint64_t WriteAheadLog::rotate() {
+    std::lock_guard<std::mutex> io_lock(io_mutex_);
+    uint64_t segment;
+    {
+        // Appends are held off for the switch, so none can land in the old segment afterwards
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (failed() || !write_out(buffer_)) {
+            fail();
+            durable_cv_.notify_all();
+            throw std::runtime_error("write-ahead log failed");
+        }
+        buffer_.clear();
+        durable_sequence_ = next_sequence_ - 1;
+        ::close(fd_);
+        open_segment(segment_ + 1);
+        segment = segment_;
+    }
+    durable_cv_.notify_all();
+    return segment;
+}
+
+bool WriteAheadLog::complete_from(const std::string& directory, uint64_t first_segment) {
+    auto segments = list_segments(directory);
+    auto it = std::lower_bound(segments.begin(), segments.end(), first_segment);
+    uint64_t expected = std::max<uint64_t>(first_segment, 1);
+    for (; it != segments.end(); ++it, ++expected) {
+        if (*it != expected) return false;
+    }
+    return expected > std::max<uint64_t>(first_segment, 1);
+}
+
+void WriteAheadLog::remove_segments_before(uint64_t segment) {
+    for (uint64_t old : list_segments(directory_)) {
+        if (old >= segment) break;
+        std::error_code ec;
+        std::filesystem::remove(segment_path(directory_, old), ec);
+    }
+}
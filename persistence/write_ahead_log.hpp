@@ -0,0 +1,127 @@
+#ifndef WRITE_AHEAD_LOG_HPP
+#define WRITE_AHEAD_LOG_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Append-only log of every applied SET/DEL, stored as numbered segment files
+// (wal-000001.log, ...) in one directory.
+//
+// Writers only copy their record into a shared in-memory buffer. A single flusher
+// thread writes the buffer out and fsyncs it, so every writer that appended while
+// the previous fsync was running shares the next one (group commit).
+//
+// A write or fsync that fails puts the log in a failed state for good: the segment is
+// cut back to its last whole batch, nothing more is written, and every writer from then
+// on gets an error rather than an acknowledgement a restart could not honour.
+//
+// Record layout: u32 body length, u32 CRC-32 of the body, then the body:
+//   u8 type, u64 timestamp, u32 key length, u32 value length, key, value
+// and, for RECORD_SET_TTL only, a trailing u64 expire_at.
+// Integers are little-endian.
+class WriteAheadLog {
+public:
+    enum class SyncPolicy {
+        PER_OPERATION,  // A write returns only once its record is fsynced
+        INTERVAL,       // fsync every interval_ms
+        BYTES           // fsync whenever sync_bytes have accumulated
+    };
+
+    struct Options {
+        SyncPolicy policy = SyncPolicy::INTERVAL;
+        uint64_t interval_ms = 10;
+        size_t sync_bytes = 1 << 20;
+        // Writers block once this much is waiting for the flusher
+        size_t max_buffer_bytes = 64 << 20;
+    };
+
+    enum RecordType : uint8_t {
+        RECORD_SET = 1,
+        RECORD_DEL = 2,
+        RECORD_SET_TTL = 3  // A SET of a key that expires at expire_at (wall-clock ms)
+    };
+
+    struct Record {
+        RecordType type;
+        uint64_t timestamp;
+        std::string key;
+        std::string value;
+        uint64_t expire_at = 0;
+    };
+
+    WriteAheadLog(const std::string& directory, Options options);
+    ~WriteAheadLog();
+
+    // Replays the records of every segment numbered first_segment or later, in order.
+    // A torn or corrupt record ends its segment. Returns the number of records applied.
+    static size_t replay(const std::string& directory, const std::function<void(const Record&)>& apply,
+                         uint64_t first_segment = 0);
+
+    // True if no segment replay from first_segment needs is missing: first_segment (or,
+    // for 0, the very first segment) and every segment after it are still on disk
+    static bool complete_from(const std::string& directory, uint64_t first_segment);
+
+    // Opens a fresh segment after the newest existing one and starts the flusher
+    void open();
+    void close();
+
+    // Buffers one record and returns its sequence number. Call under the lock that
+    // ordered the write, so the log order matches the store order for each key, and
+    // before applying it: throws std::runtime_error if the log has failed.
+    uint64_t append(RecordType type, const std::string& key, const std::string& value, uint64_t timestamp,
+                    uint64_t expire_at = 0);
+
+    // Under PER_OPERATION, blocks until the record is on disk; otherwise returns at once.
+    // Throws std::runtime_error if the log has failed.
+    void wait_durable(uint64_t sequence);
+
+    // Writes and fsyncs everything appended so far; throws if the log has failed
+    void sync();
+
+    // Flushes the current segment and switches to a new one. Every record appended
+    // after this returns lands in the returned segment or a later one. Throws if the
+    // flush fails.
+    uint64_t rotate();
+
+    bool failed() const { return failed_.load(std::memory_order_acquire); }
+
+    // Deletes segments numbered below segment, once a snapshot has made them redundant
+    void remove_segments_before(uint64_t segment);
+
+    const std::string& directory() const { return directory_; }
+
+private:
+    void run();
+    bool flush_due() const;
+    // Writes and fsyncs a batch; on failure cuts the segment back to where it started
+    bool write_out(const std::string& batch);
+    // Called with mutex_ held
+    void fail();
+    void open_segment(uint64_t segment);
+    static std::string segment_path(const std::string& directory, uint64_t segment);
+
+    std::string directory_;
+    Options options_;
+    int fd_ = -1;
+    uint64_t segment_ = 0;
+    uint64_t offset_ = 0;  // Bytes of whole batches in the current segment
+
+    std::mutex io_mutex_;  // Held while a batch is written, so rotation cannot reorder batches
+    std::mutex mutex_;
+    std::condition_variable flush_cv_;    // Wakes the flusher
+    std::condition_variable durable_cv_;  // Wakes writers waiting for their fsync
+    std::string buffer_;
+    uint64_t next_sequence_ = 1;
+    uint64_t durable_sequence_ = 0;
+    uint64_t sync_requested_ = 0;
+    bool stopping_ = false;
+    std::atomic<bool> failed_{false};
+    std::thread flusher_thread_;
+};
+
+#endif // WRITE_AHEAD_LOG_HPP
@@ -0,0 +1,387 @@
+#ifndef BINARY_PROTOCOL_HPP
+#define BINARY_PROTOCOL_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Length-prefixed binary framing, negotiated per connection.
+//
+// A connection starts in text mode; the text command "PROTOCOL BINARY" is answered
+// with "OK" and every byte after it is parsed as binary frames. All integers are
+// big-endian.
+//
+// Request frame (16-byte header followed by key and value bytes):
+//   0  opcode     u8
+//   1  flags      u8
+//   2  key_len    u16
+//   4  value_len  u32
+//   8  timestamp  u64   (HybridClock value of a FLAG_PROPAGATED write; otherwise ignored and
+//                        assigned by the receiving node)
+//
+// Response frame (8-byte header followed by the payload):
+//   0  status       u8
+//   1  reserved     u8[3]
+//   4  payload_len  u32
+//
+// Bulk replies (GET_ALL, GET_BUCKETS, GET_ENTRIES, TRANSFER) are streamed as any number of
+// STATUS_MORE frames followed by one final STATUS_OK frame, each holding whole
+// records, so neither side ever buffers more than one chunk. Records are
+//   GET_ALL:     u16 key_len, key, u64 timestamp
+//   GET_BUCKETS: u16 key_len, key, u64 timestamp, u64 digest
+//   GET_ENTRIES: u16 key_len, key, u64 timestamp, u8 flags, u64 expire_at, u32 value_len, value
+//                (flags: ENTRY_TOMBSTONE; expire_at 0 for a key without a TTL)
+//   TRANSFER:    as GET_ENTRIES
+//
+// A SET with FLAG_TTL carries the key's expiry time (wall-clock ms) as a u64 in
+// front of the value.
+//
+// Anti-entropy requests: MERKLE_ROOT (no payload) returns 32 hash bytes followed by the
+// node's tombstone safe point (see AntiEntropyManager) as a u64;
+// MERKLE_LEVEL's value is u32 level followed by u32 node ids and returns 32 bytes
+// per descendant node; GET_BUCKETS's value is a list of u32 bucket ids;
+// GET_ENTRIES's value is a list of u16 key_len, key records and its reply carries
+// each key's value with its original write timestamp, or its tombstone.
+//
+// TRANSFER's value is a u32 partition (see HashRing). The reply carries every entry of
+// the partition, then the entries of its keys written while it was being sent.
+//
+// GOSSIP's value is the sender's member table and the reply is the receiver's, both as
+// records of u8 node_id, u16 host_len, host, u16 port, u64 heartbeat.
+namespace binary_protocol {
+
+constexpr const char* kHandshake = "PROTOCOL BINARY";
+constexpr size_t kRequestHeaderSize = 16;
+constexpr size_t kResponseHeaderSize = 8;
+// Every key length on the wire is a u16, so longer keys are refused before they get here
+constexpr size_t kMaxKeySize = UINT16_MAX;
+// Soft size of one streamed chunk; a chunk ends after the record that crosses it
+constexpr size_t kStreamChunkSize = 64 * 1024;
+
+enum Opcode : uint8_t {
+    OP_GET = 1,
+    OP_SET = 2,
+    OP_DEL = 3,
+    OP_GET_ALL = 4,
+    OP_MERKLE_ROOT = 5,
+    OP_MERKLE_LEVEL = 6,
+    OP_GET_BUCKETS = 7,
+    OP_GET_ENTRIES = 8,
+    OP_GOSSIP = 9,
+    OP_TRANSFER = 10
+};
+
+enum Flags : uint8_t {
+    FLAG_PROPAGATED = 0x01,  // Mutation replicated from a peer; not propagated again
+    FLAG_QUIET = 0x02,       // No response frame is sent
+    FLAG_TTL = 0x04          // SET: the value starts with a u64 expiry time
+};
+
+enum EntryFlags : uint8_t {
+    ENTRY_TOMBSTONE = 0x01  // The key was deleted or expired; the record has no value
+};
+
+enum Status : uint8_t {
+    STATUS_OK = 0,
+    STATUS_NOT_FOUND = 1,
+    STATUS_ERROR = 2,
+    STATUS_MORE = 3,  // One chunk of a streamed reply; more frames follow
+    STATUS_MOVED = 4  // The key's partition is held elsewhere; the payload is its primary's host:port
+};
+
+enum class ParseResult {
+    OK,
+    INCOMPLETE,  // Need more bytes
+    INVALID      // Unknown opcode or oversized frame; the connection should be dropped
+};
+
+// Key and value point into the buffer that was parsed; they are valid until it changes
+struct Request {
+    Opcode opcode;
+    uint8_t flags;
+    uint64_t timestamp;
+    std::string_view key;
+    std::string_view value;
+};
+
+inline uint16_t load_u16(const char* p) {
+    const auto* b = reinterpret_cast<const uint8_t*>(p);
+    return static_cast<uint16_t>((b[0] << 8) | b[1]);
+}
+
+inline uint32_t load_u32(const char* p) {
+    const auto* b = reinterpret_cast<const uint8_t*>(p);
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+}
+
+inline uint64_t load_u64(const char* p) {
+    return (uint64_t(load_u32(p)) << 32) | load_u32(p + 4);
+}
+
+inline void store_u16(char* p, uint16_t v) {
+    p[0] = static_cast<char>(v >> 8);
+    p[1] = static_cast<char>(v);
+}
+
+inline void store_u32(char* p, uint32_t v) {
+    for (int i = 3; i >= 0; i--, v >>= 8) p[i] = static_cast<char>(v);
+}
+
+inline void store_u64(char* p, uint64_t v) {
+    store_u32(p, static_cast<uint32_t>(v >> 32));
+    store_u32(p + 4, static_cast<uint32_t>(v));
+}
+
+// Parses the frame at the front of [data, data + size) in place. On OK, consumed is the
+// frame length and the request's key/value are views into data.
+inline ParseResult parse_request(const char* data, size_t size, size_t max_frame_size,
+                                 Request& out, size_t& consumed) {
+    if (size < kRequestHeaderSize) {
+        return ParseResult::INCOMPLETE;
+    }
+    uint8_t opcode = static_cast<uint8_t>(data[0]);
+    if (opcode < OP_GET || opcode > OP_TRANSFER) {
+        return ParseResult::INVALID;
+    }
+    size_t key_len = load_u16(data + 2);
+    size_t value_len = load_u32(data + 4);
+    size_t frame_size = kRequestHeaderSize + key_len + value_len;
+    if (frame_size > max_frame_size) {
+        return ParseResult::INVALID;
+    }
+    if (size < frame_size) {
+        return ParseResult::INCOMPLETE;
+    }
+    out.opcode = static_cast<Opcode>(opcode);
+    out.flags = static_cast<uint8_t>(data[1]);
+    out.timestamp = load_u64(data + 8);
+    out.key = std::string_view(data + kRequestHeaderSize, key_len);
+    out.value = std::string_view(data + kRequestHeaderSize + key_len, value_len);
+    consumed = frame_size;
+    return ParseResult::OK;
+}
+
+inline void encode_request(std::string& out, Opcode opcode, std::string_view key,
+                           std::string_view value = {}, uint64_t timestamp = 0, uint8_t flags = 0) {
+    assert(key.size() <= kMaxKeySize);
+    char header[kRequestHeaderSize];
+    header[0] = static_cast<char>(opcode);
+    header[1] = static_cast<char>(flags);
+    store_u16(header + 2, static_cast<uint16_t>(key.size()));
+    store_u32(header + 4, static_cast<uint32_t>(value.size()));
+    store_u64(header + 8, timestamp);
+    out.append(header, kRequestHeaderSize);
+    out.append(key.data(), key.size());
+    out.append(value.data(), value.size());
+}
+
+inline void encode_response_header(char* header, Status status, uint32_t payload_len) {
+    header[0] = static_cast<char>(status);
+    header[1] = header[2] = header[3] = 0;
+    store_u32(header + 4, payload_len);
+}
+
+inline void append_u16(std::string& out, uint16_t v) {
+    char bytes[2];
+    store_u16(bytes, v);
+    out.append(bytes, 2);
+}
+
+inline void append_u32(std::string& out, uint32_t v) {
+    char bytes[4];
+    store_u32(bytes, v);
+    out.append(bytes, 4);
+}
+
+inline void append_u64(std::string& out, uint64_t v) {
+    char bytes[8];
+    store_u64(bytes, v);
+    out.append(bytes, 8);
+}
+
+inline void append_key(std::string& out, std::string_view key) {
+    assert(key.size() <= kMaxKeySize);
+    append_u16(out, static_cast<uint16_t>(key.size()));
+    out.append(key.data(), key.size());
+}
+
+inline void append_key_timestamp(std::string& out, std::string_view key, uint64_t timestamp) {
+    append_key(out, key);
+    append_u64(out, timestamp);
+}
+
+inline void append_bucket_entry(std::string& out, std::string_view key, uint64_t timestamp, uint64_t digest) {
+    append_key_timestamp(out, key, timestamp);
+    append_u64(out, digest);
+}
+
+inline void append_entry(std::string& out, std::string_view key, uint64_t timestamp, std::string_view value,
+                         uint64_t expire_at = 0, uint8_t flags = 0) {
+    append_key_timestamp(out, key, timestamp);
+    out.push_back(static_cast<char>(flags));
+    append_u64(out, expire_at);
+    append_u32(out, static_cast<uint32_t>(value.size()));
+    out.append(value.data(), value.size());
+}
+
+inline void append_member(std::string& out, uint8_t node_id, std::string_view host, uint16_t port,
+                          uint64_t heartbeat) {
+    out.push_back(static_cast<char>(node_id));
+    append_key(out, host);
+    append_u16(out, port);
+    append_u64(out, heartbeat);
+}
+
+// The value of a SET with FLAG_TTL
+inline std::string ttl_value(uint64_t expire_at, std::string_view value) {
+    std::string out;
+    out.reserve(8 + value.size());
+    append_u64(out, expire_at);
+    out.append(value.data(), value.size());
+    return out;
+}
+
+// One GET_ENTRIES record; the views point into the chunk it was read from
+struct EntryRecord {
+    std::string_view key;
+    uint64_t timestamp;
+    uint8_t flags;
+    uint64_t expire_at;
+    std::string_view value;
+
+    bool tombstone() const { return flags & ENTRY_TOMBSTONE; }
+};
+
+// Bounds-checked sequential reads over the records of one payload
+class RecordCursor {
+public:
+    explicit RecordCursor(std::string_view data) : data_(data) {}
+
+    bool done() const { return pos_ == data_.size(); }
+
+    bool read_key(std::string_view& key) {
+        if (!has(2)) return false;
+        size_t key_len = load_u16(data_.data() + pos_);
+        pos_ += 2;
+        return read_bytes(key_len, key);
+    }
+
+    bool read_u8(uint8_t& v) {
+        if (!has(1)) return false;
+        v = static_cast<uint8_t>(data_[pos_++]);
+        return true;
+    }
+
+    bool read_u16(uint16_t& v) {
+        if (!has(2)) return false;
+        v = load_u16(data_.data() + pos_);
+        pos_ += 2;
+        return true;
+    }
+
+    bool read_u32(uint32_t& v) {
+        if (!has(4)) return false;
+        v = load_u32(data_.data() + pos_);
+        pos_ += 4;
+        return true;
+    }
+
+    bool read_u64(uint64_t& v) {
+        if (!has(8)) return false;
+        v = load_u64(data_.data() + pos_);
+        pos_ += 8;
+        return true;
+    }
+
+    bool read_bytes(size_t n, std::string_view& out) {
+        if (!has(n)) return false;
+        out = data_.substr(pos_, n);
+        pos_ += n;
+        return true;
+    }
+
+private:
+    bool has(size_t n) const { return data_.size() - pos_ >= n; }
+
+    std::string_view data_;
+    size_t pos_ = 0;
+};
+
+// The for_each_* helpers call their callback for every record of a payload and
+// return false if it is malformed
+
+template <typename OnKey>
+bool for_each_key(std::string_view payload, OnKey on_key) {
+    RecordCursor cursor(payload);
+    std::string_view key;
+    while (!cursor.done()) {
+        if (!cursor.read_key(key)) return false;
+        on_key(key);
+    }
+    return true;
+}
+
+template <typename OnRecord>
+bool for_each_key_timestamp(std::string_view chunk, OnRecord on_record) {
+    RecordCursor cursor(chunk);
+    std::string_view key;
+    uint64_t timestamp;
+    while (!cursor.done()) {
+        if (!cursor.read_key(key) || !cursor.read_u64(timestamp)) return false;
+        on_record(key, timestamp);
+    }
+    return true;
+}
+
+template <typename OnRecord>
+bool for_each_bucket_entry(std::string_view chunk, OnRecord on_record) {
+    RecordCursor cursor(chunk);
+    std::string_view key;
+    uint64_t timestamp, digest;
+    while (!cursor.done()) {
+        if (!cursor.read_key(key) || !cursor.read_u64(timestamp) || !cursor.read_u64(digest)) return false;
+        on_record(key, timestamp, digest);
+    }
+    return true;
+}
+
+// on_record(const EntryRecord&)
+template <typename OnRecord>
+bool for_each_entry(std::string_view chunk, OnRecord on_record) {
+    RecordCursor cursor(chunk);
+    EntryRecord record;
+    uint32_t value_len;
+    while (!cursor.done()) {
+        if (!cursor.read_key(record.key) || !cursor.read_u64(record.timestamp) || !cursor.read_u8(record.flags) ||
+            !cursor.read_u64(record.expire_at) || !cursor.read_u32(value_len) ||
+            !cursor.read_bytes(value_len, record.value)) {
+            return false;
+        }
+        on_record(record);
+    }
+    return true;
+}
+
+// on_member(node_id, host, port, heartbeat)
+template <typename OnMember>
+bool for_each_member(std::string_view payload, OnMember on_member) {
+    RecordCursor cursor(payload);
+    uint8_t node_id;
+    std::string_view host;
+    uint16_t port;
+    uint64_t heartbeat;
+    while (!cursor.done()) {
+        if (!cursor.read_u8(node_id) || !cursor.read_key(host) || !cursor.read_u16(port) ||
+            !cursor.read_u64(heartbeat)) {
+            return false;
+        }
+        on_member(node_id, host, port, heartbeat);
+    }
+    return true;
+}
+
+} // namespace binary_protocol
+
+#endif // BINARY_PROTOCOL_HPP
@@ -0,0 +1,92 @@
+#ifndef FRAME_READER_HPP
+#define FRAME_READER_HPP
+
+#include <boost/asio.hpp>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "binary_protocol.hpp"
+
+// Blocking reader for binary protocol responses on a client socket. Reads are
+// buffered, so pipelined small replies cost few syscalls, and the buffer only ever
+// holds one frame: a streamed reply of any size is consumed chunk by chunk.
+class FrameReader {
+public:
+    explicit FrameReader(boost::asio::ip::tcp::socket& socket, size_t max_frame_size = 16 * 1024 * 1024)
+        : socket_(socket), max_frame_size_(max_frame_size), buffer_(64 * 1024) {}
+
+    // Reads the next response frame. The payload view is valid until the next call.
+    binary_protocol::Status read_frame(std::string_view& payload) {
+        fill(binary_protocol::kResponseHeaderSize);
+        const char* header = buffer_.data() + start_;
+        auto status = static_cast<binary_protocol::Status>(header[0]);
+        size_t length = binary_protocol::load_u32(header + 4);
+        if (length > max_frame_size_) {
+            throw std::runtime_error("response frame of " + std::to_string(length) + " bytes exceeds limit");
+        }
+        start_ += binary_protocol::kResponseHeaderSize;
+        fill(length);
+        payload = std::string_view(buffer_.data() + start_, length);
+        start_ += length;
+        return status;
+    }
+
+    // Reads a whole streamed reply, calling on_chunk(chunk) as each chunk arrives.
+    // on_chunk returns false for a malformed chunk, typically by forwarding one of
+    // the binary_protocol::for_each_* helpers.
+    template <typename OnChunk>
+    void read_stream(OnChunk on_chunk) {
+        while (true) {
+            std::string_view chunk;
+            auto status = read_frame(chunk);
+            if (status != binary_protocol::STATUS_OK && status != binary_protocol::STATUS_MORE) {
+                throw std::runtime_error("peer returned error status " + std::to_string(status));
+            }
+            if (!on_chunk(chunk)) {
+                throw std::runtime_error("malformed stream chunk");
+            }
+            if (status == binary_protocol::STATUS_OK) return;
+        }
+    }
+
+private:
+    // Makes sure `size` unread bytes are buffered, growing the buffer only for a frame that needs it
+    void fill(size_t size) {
+        if (end_ - start_ >= size) return;
+        if (start_ + size > buffer_.size()) {
+            std::memmove(buffer_.data(), buffer_.data() + start_, end_ - start_);
+            end_ -= start_;
+            start_ = 0;
+            if (size > buffer_.size()) buffer_.resize(size);
+        }
+        while (end_ - start_ < size) {
+            end_ += socket_.read_some(boost::asio::buffer(buffer_.data() + end_, buffer_.size() - end_));
+        }
+    }
+
+    boost::asio::ip::tcp::socket& socket_;
+    size_t max_frame_size_;
+    std::vector<char> buffer_;
+    size_t start_ = 0;
+    size_t end_ = 0;
+};
+
+// Connects to a node and switches the connection to the binary protocol. Exactly the
+// "OK\n" reply is consumed, so the first response frame is left on the socket.
+inline void connect_binary(boost::asio::ip::tcp::socket& socket, const std::string& host, short port) {
+    boost::asio::ip::tcp::resolver resolver(socket.get_executor());
+    boost::asio::connect(socket, resolver.resolve(host, std::to_string(port)));
+    socket.set_option(boost::asio::ip::tcp::no_delay(true));
+
+    std::string handshake = std::string(binary_protocol::kHandshake) + "\n";
+    boost::asio::write(socket, boost::asio::buffer(handshake));
+    char reply[3];
+    boost::asio::read(socket, boost::asio::buffer(reply));
+    if (std::memcmp(reply, "OK\n", sizeof(reply)) != 0) {
+        throw std::runtime_error("peer rejected binary protocol");
+    }
+}
+
+#endif // FRAME_READER_HPP
@@ -0,0 +1,157 @@
+#ifndef TEXT_PARSER_HPP
+#define TEXT_PARSER_HPP
+
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+
+// Parser for one line of the text protocol:
+//
+//   [PROPAGATE <timestamp>] <COMMAND> [key] [value] [options]
+//
+// A PROPAGATE prefix marks a write replicated from another node and carries the
+// HybridClock timestamp it was stamped with there, so every replica applies it at the
+// same timestamp.
+//
+// Fields are separated by runs of whitespace, as with stream extraction. Parsing
+// works in place: every field of the result is a view into the line, so nothing is
+// allocated or copied, and the views stay valid as long as the line does.
+namespace text_protocol {
+
+enum class Command : uint8_t {
+    UNKNOWN,
+    GET,
+    SET,
+    DEL,
+    GET_ALL,
+    GET_MERKLE_ROOT,
+    GET_MERKLE_LEVEL,
+    GET_BUCKETS,
+    GET_PATHS,
+    STATS,
+    EXPIRE,
+    CLUSTER,
+    PROPAGATE  // Prefix only; never the command of a parsed request
+};
+
+struct Request {
+    Command command = Command::UNKNOWN;
+    bool propagated = false;
+    uint64_t timestamp = 0;    // Of a PROPAGATE write
+    std::string_view key;      // First argument
+    std::string_view value;    // Second argument
+    std::string_view options;  // Everything after the second argument, e.g. "EX 60" for SET
+    std::string_view args;     // Everything after the command word, leading whitespace removed
+};
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+inline std::string_view skip_space(std::string_view text) {
+    size_t pos = 0;
+    while (pos < text.size() && is_space(text[pos])) pos++;
+    return text.substr(pos);
+}
+
+// Removes and returns the next whitespace-delimited token of text
+inline std::string_view next_token(std::string_view& text) {
+    text = skip_space(text);
+    size_t end = 0;
+    while (end < text.size() && !is_space(text[end])) end++;
+    std::string_view token = text.substr(0, end);
+    text.remove_prefix(end);
+    return token;
+}
+
+// Dispatches on length first, so each word is compared against at most two names
+inline Command command_of(std::string_view word) {
+    switch (word.size()) {
+    case 3:
+        if (word == "GET") return Command::GET;
+        if (word == "SET") return Command::SET;
+        if (word == "DEL") return Command::DEL;
+        break;
+    case 5:
+        if (word == "STATS") return Command::STATS;
+        break;
+    case 6:
+        if (word == "EXPIRE") return Command::EXPIRE;
+        break;
+    case 7:
+        if (word == "GET_ALL") return Command::GET_ALL;
+        if (word == "CLUSTER") return Command::CLUSTER;
+        break;
+    case 9:
+        if (word == "GET_PATHS") return Command::GET_PATHS;
+        if (word == "PROPAGATE") return Command::PROPAGATE;
+        break;
+    case 11:
+        if (word == "GET_BUCKETS") return Command::GET_BUCKETS;
+        break;
+    case 15:
+        if (word == "GET_MERKLE_ROOT") return Command::GET_MERKLE_ROOT;
+        break;
+    case 16:
+        if (word == "GET_MERKLE_LEVEL") return Command::GET_MERKLE_LEVEL;
+        break;
+    }
+    return Command::UNKNOWN;
+}
+
+// Parses a whole field as a decimal number; false if it is empty or not a number
+inline bool parse_uint(std::string_view text, uint64_t& out) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size() && !text.empty();
+}
+
+inline Request parse(std::string_view line) {
+    Request request;
+    request.command = command_of(next_token(line));
+    if (request.command == Command::PROPAGATE) {
+        request.propagated = true;
+        bool stamped = parse_uint(next_token(line), request.timestamp) && request.timestamp != 0;
+        request.command = command_of(next_token(line));
+        if (!stamped || request.command == Command::PROPAGATE) request.command = Command::UNKNOWN;
+    }
+    request.args = skip_space(line);
+    request.key = next_token(line);
+    request.value = next_token(line);
+    request.options = skip_space(line);
+    return request;
+}
+
+// Longest TTL accepted, about a century, so expiry times cannot overflow
+constexpr uint64_t max_ttl_seconds = uint64_t(1) << 32;
+
+// A TTL in whole seconds, as given to EXPIRE and SET ... EX
+inline bool parse_ttl(std::string_view text, uint64_t& seconds) {
+    return parse_uint(text, seconds) && seconds <= max_ttl_seconds;
+}
+
+// SET's options: none, or "EX <seconds>" with seconds > 0. ttl_seconds is left at 0
+// when there is no TTL.
+inline bool parse_set_options(std::string_view options, uint64_t& ttl_seconds) {
+    if (options.empty()) {
+        return true;
+    }
+    std::string_view name = next_token(options);
+    std::string_view seconds = next_token(options);
+    return name == "EX" && skip_space(options).empty() && parse_ttl(seconds, ttl_seconds) && ttl_seconds > 0;
+}
+
+// Calls on_item(item) for every non-empty item of a ';'-separated list
+template <typename OnItem>
+void for_each_item(std::string_view list, OnItem on_item) {
+    while (!list.empty()) {
+        size_t end = list.find(';');
+        std::string_view item = list.substr(0, end);
+        if (!item.empty()) on_item(item);
+        if (end == std::string_view::npos) break;
+        list.remove_prefix(end + 1);
+    }
+}
+
+} // namespace text_protocol
+
+#endif // TEXT_PARSER_HPP
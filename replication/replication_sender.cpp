@@ -0,0 +1,150 @@
+#include "replication_sender.hpp"
+#include "protocol/frame_reader.hpp"
+#include <chrono>
+#include "logging/logger.hpp"
+
+using boost::asio::ip::tcp;
+
+ReplicationSender::ReplicationSender(const std::string& peer_host, short peer_port, size_t max_pending_keys,
+                                     size_t max_pending_bytes)
+    : peer_host_(peer_host), peer_port_(peer_port), max_pending_keys_(max_pending_keys),
+      max_pending_bytes_(max_pending_bytes), socket_(io_context_) {}
+
+ReplicationSender::~ReplicationSender() {
+    stop();
+}
+
+void ReplicationSender::start() {
+    sender_thread_ = std::thread([this]() { run(); });
+}
+
+void ReplicationSender::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (sender_thread_.joinable()) {
+        sender_thread_.join();
+    }
+}
+
+bool ReplicationSender::enqueue(binary_protocol::Opcode opcode, const std::string& key,
+                                const std::string& value, uint64_t timestamp, uint64_t expire_at) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!has_room(key, value.size())) {
+            if (!overflowing_) {
+                KV_LOG_WARN("Replication queue to " << peer_host_ << ":" << peer_port_
+                            << " is full; dropping writes until it drains");
+                overflowing_ = true;
+            }
+            return false;
+        }
+        merge(key, {opcode, value, timestamp, expire_at});
+    }
+    cv_.notify_one();
+    return true;
+}
+
+bool ReplicationSender::has_room(const std::string& key, size_t value_size) const {
+    auto it = pending_.find(key);
+    if (it == pending_.end()) {
+        return pending_.size() < max_pending_keys_ && pending_bytes_ + key.size() + value_size <= max_pending_bytes_;
+    }
+    // Replacing a queued write only needs room for the difference
+    return value_size <= it->second.value.size() ||
+           pending_bytes_ + value_size - it->second.value.size() <= max_pending_bytes_;
+}
+
+void ReplicationSender::merge(const std::string& key, Mutation mutation) {
+    auto it = pending_.find(key);
+    if (it == pending_.end()) {
+        pending_bytes_ += key.size() + mutation.value.size();
+        pending_.emplace(key, std::move(mutation));
+    } else if (mutation.timestamp >= it->second.timestamp) {
+        pending_bytes_ = pending_bytes_ + mutation.value.size() - it->second.value.size();
+        it->second = std::move(mutation);
+    }
+}
+
+void ReplicationSender::requeue(Batch& batch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [key, mutation] : batch) {
+        if (has_room(key, mutation.value.size())) {
+            merge(key, std::move(mutation));
+        }
+    }
+}
+
+void ReplicationSender::run() {
+    const int initial_delay = 100; // milliseconds
+    const int max_delay = 5000;
+    int delay = initial_delay;
+
+    while (true) {
+        Batch batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stopping_ || !pending_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            batch.swap(pending_);
+            pending_bytes_ = 0;
+            overflowing_ = false;
+        }
+
+        if (ensure_connected() && send_batch(batch)) {
+            delay = initial_delay;
+            continue;
+        }
+
+        // Peer unreachable: keep the batch and back off exponentially before retrying
+        requeue(batch);
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, std::chrono::milliseconds(delay), [this]() { return stopping_; });
+        delay = std::min(delay * 2, max_delay);
+    }
+}
+
+bool ReplicationSender::ensure_connected() {
+    if (socket_.is_open()) {
+        return true;
+    }
+    try {
+        connect_binary(socket_, peer_host_, peer_port_);
+        return true;
+    } catch (std::exception& e) {
+        KV_LOG_WARN("Failed to connect to replication peer " << peer_host_ << ":" << peer_port_
+                    << ": " << e.what());
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        return false;
+    }
+}
+
+bool ReplicationSender::send_batch(const Batch& batch) {
+    // Quiet frames: the peer sends nothing back, so the connection is write-only
+    const uint8_t flags = binary_protocol::FLAG_PROPAGATED | binary_protocol::FLAG_QUIET;
+    std::string frames;
+    for (const auto& [key, mutation] : batch) {
+        if (mutation.expire_at) {
+            binary_protocol::encode_request(frames, mutation.opcode, key,
+                                            binary_protocol::ttl_value(mutation.expire_at, mutation.value),
+                                            mutation.timestamp,
+                                            static_cast<uint8_t>(flags | binary_protocol::FLAG_TTL));
+        } else {
+            binary_protocol::encode_request(frames, mutation.opcode, key, mutation.value, mutation.timestamp, flags);
+        }
+    }
+    try {
+        boost::asio::write(socket_, boost::asio::buffer(frames));
+        return true;
+    } catch (std::exception& e) {
+        KV_LOG_WARN("Failed to propagate " << batch.size() << " updates: " << e.what());
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        return false;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef REPLICATION_SENDER_HPP
+#define REPLICATION_SENDER_HPP
+
+#include <boost/asio.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "protocol/binary_protocol.hpp"
+
+// Streams local writes to one peer. A single sender thread owns a long-lived binary
+// protocol connection; writes are queued per key, so repeated writes to a key that
+// has not been sent yet collapse into the newest one, and everything pending is
+// flushed to the peer in one batched write.
+//
+// The queue holds at most max_pending_keys keys and max_pending_bytes of keys and
+// values, so a slow or dead peer cannot pin more than that.
+class ReplicationSender {
+public:
+    ReplicationSender(const std::string& peer_host, short peer_port, size_t max_pending_keys = 100000,
+                      size_t max_pending_bytes = size_t(64) << 20);
+    ~ReplicationSender();
+
+    void start();
+    void stop();
+
+    // Queues a SET or DEL for the peer; a SET with a non-zero expire_at carries the key's
+    // TTL. Returns false when the queue is full; the mutation is then dropped and left
+    // for anti-entropy to repair.
+    bool enqueue(binary_protocol::Opcode opcode, const std::string& key,
+                 const std::string& value, uint64_t timestamp, uint64_t expire_at = 0);
+
+private:
+    struct Mutation {
+        binary_protocol::Opcode opcode;
+        std::string value;
+        uint64_t timestamp;
+        uint64_t expire_at;
+    };
+    using Batch = std::unordered_map<std::string, Mutation>;
+
+    void run();
+    bool ensure_connected();
+    bool send_batch(const Batch& batch);
+    // Puts an unsent batch back, unless a newer write to the same key arrived meanwhile
+    void requeue(Batch& batch);
+    // Called with mutex_ held
+    bool has_room(const std::string& key, size_t value_size) const;
+    void merge(const std::string& key, Mutation mutation);
+
+    std::string peer_host_;
+    short peer_port_;
+    size_t max_pending_keys_;
+    size_t max_pending_bytes_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    Batch pending_;
+    size_t pending_bytes_ = 0;  // Key and value bytes in pending_
+    bool stopping_ = false;
+    bool overflowing_ = false;
+
+    boost::asio::io_context io_context_;
+    boost::asio::ip::tcp::socket socket_;
+    std::thread sender_thread_;
+};
+
+#endif // REPLICATION_SENDER_HPP
@@ -0,0 +1,102 @@
+#ifndef CHANGE_LOG_HPP
+#define CHANGE_LOG_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Keys written to a range while the range is being copied to another node.
+//
+// A range transfer opens a capture before it reads the first key of the range, so a
+// write that the copy misses is always recorded. The store records the key, not the
+// value, of every write to a captured key; the transfer then drains the keys and sends
+// their entries as they are by then. A key written many times is sent once per drain.
+// While no capture is open, recording costs one atomic load per write.
+//
+// A capture holds at most max_keys keys. One that fills up stops recording and says
+// so, and what it missed is left to anti-entropy.
+class ChangeLog {
+public:
+    using Covers = std::function<bool(std::string_view key)>;
+
+    static constexpr size_t max_keys = size_t(1) << 20;
+
+    // Records for as long as it is held
+    class Capture {
+    public:
+        Capture(const Capture&) = delete;
+        Capture& operator=(const Capture&) = delete;
+        ~Capture() { log_.close(this); }
+
+        // The keys written since the capture opened or was last drained
+        std::vector<std::string> drain() {
+            std::lock_guard<std::mutex> lock(log_.mutex_);
+            std::vector<std::string> out;
+            out.reserve(keys_.size());
+            for (auto it = keys_.begin(); it != keys_.end();) {
+                out.push_back(std::move(keys_.extract(it++).value()));
+            }
+            return out;
+        }
+
+        bool overflowed() const {
+            std::lock_guard<std::mutex> lock(log_.mutex_);
+            return overflowed_;
+        }
+
+    private:
+        friend class ChangeLog;
+        Capture(ChangeLog& log, Covers covers) : log_(log), covers_(std::move(covers)) {}
+
+        ChangeLog& log_;
+        Covers covers_;
+        std::unordered_set<std::string> keys_;  // Guarded by log_.mutex_
+        bool overflowed_ = false;
+    };
+
+    // Starts recording writes to the keys covers accepts
+    std::shared_ptr<Capture> open(Covers covers) {
+        std::shared_ptr<Capture> capture(new Capture(*this, std::move(covers)));
+        std::lock_guard<std::mutex> lock(mutex_);
+        captures_.push_back(capture.get());
+        open_.store(captures_.size(), std::memory_order_release);
+        return capture;
+    }
+
+    // Called by the store under the key's shard lock, so a capture opened after the write
+    // was applied is sure to find it in the store instead
+    void record(std::string_view key) {
+        if (open_.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (Capture* capture : captures_) {
+            if (capture->overflowed_ || !capture->covers_(key)) continue;
+            if (capture->keys_.size() >= max_keys) {
+                capture->overflowed_ = true;
+                continue;
+            }
+            capture->keys_.emplace(key);
+        }
+    }
+
+private:
+    void close(Capture* capture) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        captures_.erase(std::remove(captures_.begin(), captures_.end(), capture), captures_.end());
+        open_.store(captures_.size(), std::memory_order_release);
+    }
+
+    mutable std::mutex mutex_;
+    std::vector<Capture*> captures_;
+    std::atomic<size_t> open_{0};
+};
+
+#endif // CHANGE_LOG_HPP
@@ -0,0 +1,138 @@
+#ifndef EVICTION_HPP
+#define EVICTION_HPP
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string_view>
+
+// Per-key bookkeeping for evicting keys under a memory cap.
+//
+// Each entry carries one 32-bit access word that readers update with a relaxed
+// store while they hold only the shared shard lock. Nothing is linked or moved on
+// access. To evict, the store samples a few entries and drops the one with the
+// highest score. The word means different things depending on the policy:
+//
+//   LRU     milliseconds on a steady clock at the last access (wraps every ~49 days;
+//           ages are taken modulo 2^32)
+//   LFU     a logarithmic access counter (low 8 bits) and the minute it last decayed
+//           (high 24 bits); the counter loses one per idle minute
+//   RANDOM  unused; any sampled entry will do
+enum class EvictionPolicy : uint8_t {
+    LRU,
+    LFU,
+    RANDOM
+};
+
+namespace eviction {
+
+constexpr uint32_t lfu_initial_count = 5;  // New keys are not the first to go
+constexpr uint32_t lfu_log_factor = 10;
+
+inline uint32_t now_ms() {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+inline uint32_t minutes_of(uint32_t ms) {
+    return (ms / 60000) & 0xFFFFFF;
+}
+
+inline std::minstd_rand& random() {
+    thread_local std::minstd_rand engine(std::random_device{}());
+    return engine;
+}
+
+// LFU counter after decaying it by the minutes since it was last touched
+inline uint32_t lfu_count(uint32_t word, uint32_t now) {
+    uint32_t count = word & 0xFF;
+    uint32_t idle = (minutes_of(now) - (word >> 8)) & 0xFFFFFF;
+    return idle >= count ? 0 : count - idle;
+}
+
+inline uint32_t initial(EvictionPolicy policy, uint32_t now) {
+    return policy == EvictionPolicy::LFU ? (minutes_of(now) << 8) | lfu_initial_count : now;
+}
+
+inline uint32_t touched(EvictionPolicy policy, uint32_t word, uint32_t now) {
+    if (policy != EvictionPolicy::LFU) {
+        return now;
+    }
+    // Incremented with probability 1/((count - initial) * factor + 1), so 255 takes
+    // on the order of a million hits
+    uint32_t count = lfu_count(word, now);
+    if (count < 255) {
+        uint32_t base = count > lfu_initial_count ? count - lfu_initial_count : 0;
+        if (random()() % (base * lfu_log_factor + 1) == 0) count++;
+    }
+    return (minutes_of(now) << 8) | count;
+}
+
+// Higher is a better victim
+inline uint64_t score(EvictionPolicy policy, uint32_t word, uint32_t now) {
+    switch (policy) {
+    case EvictionPolicy::LRU:
+        return now - word;
+    case EvictionPolicy::LFU:
+        return 255 - lfu_count(word, now);
+    case EvictionPolicy::RANDOM:
+        break;
+    }
+    return 0;
+}
+
+inline bool parse_policy(std::string_view name, EvictionPolicy& policy) {
+    if (name == "lru") policy = EvictionPolicy::LRU;
+    else if (name == "lfu") policy = EvictionPolicy::LFU;
+    else if (name == "random") policy = EvictionPolicy::RANDOM;
+    else return false;
+    return true;
+}
+
+// "0" (no cap), "1048576", "512k", "256m", "2g"
+inline bool parse_max_memory(std::string_view text, size_t& bytes) {
+    size_t multiplier = 1;
+    if (!text.empty()) {
+        switch (text.back() | 0x20) {
+        case 'k': multiplier = size_t(1) << 10; break;
+        case 'm': multiplier = size_t(1) << 20; break;
+        case 'g': multiplier = size_t(1) << 30; break;
+        }
+        if (multiplier != 1) text.remove_suffix(1);
+    }
+    uint64_t value;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+        return false;
+    }
+    bytes = static_cast<size_t>(value) * multiplier;
+    return true;
+}
+
+// The access word of one entry. Copyable so entries can move inside the shard map.
+class AccessWord {
+public:
+    AccessWord() = default;
+    explicit AccessWord(uint32_t word) : word_(word) {}
+    AccessWord(const AccessWord& other) : word_(other.load()) {}
+    AccessWord& operator=(const AccessWord& other) {
+        store(other.load());
+        return *this;
+    }
+
+    uint32_t load() const { return word_.load(std::memory_order_relaxed); }
+    // Skips the store when nothing changed, so a hot key does not bounce its cache
+    // line between readers more than once per tick
+    void store(uint32_t word) const {
+        if (word_.load(std::memory_order_relaxed) != word) word_.store(word, std::memory_order_relaxed);
+    }
+
+private:
+    mutable std::atomic<uint32_t> word_{0};
+};
+
+} // namespace eviction
+
+#endif // EVICTION_HPP
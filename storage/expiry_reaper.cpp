@@ -0,0 +1,43 @@
+#include "expiry_reaper.hpp"
+#include "kv_store.hpp"
+#include <chrono>
+#include "logging/logger.hpp"
+
+ExpiryReaper::ExpiryReaper(KeyValueStore& kv_store) : kv_store_(kv_store) {}
+
+ExpiryReaper::~ExpiryReaper() {
+    stop();
+}
+
+void ExpiryReaper::start() {
+    stopping_ = false;
+    reaper_thread_ = std::thread([this]() { run(); });
+}
+
+void ExpiryReaper::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (reaper_thread_.joinable()) {
+        reaper_thread_.join();
+    }
+}
+
+void ExpiryReaper::run() {
+    const auto tick = std::chrono::milliseconds(TimingWheel::tick_ms);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, tick, [this]() { return stopping_; })) {
+        lock.unlock();
+        size_t expired = kv_store_.expire_due();
+        if (expired) {
+            KV_LOG_DEBUG("Expired " << expired << " keys");
+        }
+        size_t collected = kv_store_.collect_tombstones();
+        if (collected) {
+            KV_LOG_DEBUG("Collected " << collected << " tombstones");
+        }
+        lock.lock();
+    }
+}
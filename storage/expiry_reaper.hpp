@@ -0,0 +1,34 @@
+#ifndef EXPIRY_REAPER_HPP
+#define EXPIRY_REAPER_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class KeyValueStore;
+
+// Background thread that expires keys whose TTL has passed and collects tombstones past
+// the GC horizon. Every timing wheel tick it has the store advance each shard's wheels,
+// which hand over only the keys that are due, so the cost follows the number of expiring
+// keys and tombstones rather than the size of the store. Reads never wait for it: a key
+// past its TTL already reads as absent.
+class ExpiryReaper {
+public:
+    explicit ExpiryReaper(KeyValueStore& kv_store);
+    ~ExpiryReaper();
+
+    void start();
+    void stop();
+
+private:
+    void run();
+
+    KeyValueStore& kv_store_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::thread reaper_thread_;
+};
+
+#endif // EXPIRY_REAPER_HPP
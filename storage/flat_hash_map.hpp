@@ -0,0 +1,346 @@
+#ifndef FLAT_HASH_MAP_HPP
+#define FLAT_HASH_MAP_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Open-addressing hash map from string keys to V, laid out Swiss-table style.
+//
+// Entries live in one flat slot array next to a parallel array of one-byte control
+// words: empty, deleted, or the low 7 bits (H2) of a full slot's hash. A lookup
+// starts at the group of 16 control bytes picked by the rest of the hash (H1) and
+// compares H2 against the whole group at once (one SSE2 compare, or a scalar loop
+// elsewhere), touching a slot only on an H2 match; it stops at the first group with
+// an empty byte. Keys up to 23 bytes are stored inside the slot, so a typical entry
+// costs no allocation beyond the table itself.
+//
+// The table holds at most 7/8 of its capacity in full or deleted slots and doubles
+// when that is reached (or rehashes in place if most of those are tombstones).
+namespace flat_map_detail {
+
+constexpr int8_t kEmpty = -128;   // 0b10000000
+constexpr int8_t kDeleted = -2;   // 0b11111110; full slots are 0..127
+constexpr size_t kGroupWidth = 16;
+
+// 16 control bytes starting anywhere in the control array; bit i of a mask is byte i
+struct Group {
+#if defined(__SSE2__)
+    explicit Group(const int8_t* ctrl) : bytes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+    uint32_t match(int8_t h2) const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), bytes)));
+    }
+    uint32_t match_empty() const { return match(kEmpty); }
+    // Empty and deleted are the only negative values below -1
+    uint32_t match_empty_or_deleted() const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), bytes)));
+    }
+
+    __m128i bytes;
+#else
+    explicit Group(const int8_t* ctrl) { std::memcpy(bytes, ctrl, kGroupWidth); }
+
+    uint32_t match(int8_t h2) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroupWidth; i++) mask |= uint32_t(bytes[i] == h2) << i;
+        return mask;
+    }
+    uint32_t match_empty() const { return match(kEmpty); }
+    uint32_t match_empty_or_deleted() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroupWidth; i++) mask |= uint32_t(bytes[i] < -1) << i;
+        return mask;
+    }
+
+    int8_t bytes[kGroupWidth];
+#endif
+};
+
+inline unsigned lowest_bit(uint32_t mask) {
+    return static_cast<unsigned>(__builtin_ctz(mask));
+}
+
+// Key bytes, inline up to 23 bytes and on the heap beyond that. The last byte holds
+// the inline length, or kHeap.
+class InlineKey {
+public:
+    explicit InlineKey(std::string_view key) {
+        if (key.size() <= kInlineCapacity) {
+            std::memcpy(storage_, key.data(), key.size());
+            storage_[kTag] = static_cast<char>(key.size());
+        } else {
+            char* heap = new char[key.size()];
+            std::memcpy(heap, key.data(), key.size());
+            std::memcpy(storage_, &heap, sizeof(heap));
+            uint64_t size = key.size();
+            std::memcpy(storage_ + sizeof(heap), &size, sizeof(size));
+            storage_[kTag] = kHeap;
+        }
+    }
+
+    InlineKey(InlineKey&& other) noexcept {
+        std::memcpy(storage_, other.storage_, sizeof(storage_));
+        other.storage_[kTag] = 0;
+    }
+
+    InlineKey(const InlineKey&) = delete;
+    InlineKey& operator=(const InlineKey&) = delete;
+    InlineKey& operator=(InlineKey&&) = delete;
+
+    ~InlineKey() {
+        if (storage_[kTag] == kHeap) delete[] heap_data();
+    }
+
+    std::string_view view() const {
+        if (storage_[kTag] != kHeap) {
+            return std::string_view(storage_, static_cast<unsigned char>(storage_[kTag]));
+        }
+        uint64_t size;
+        std::memcpy(&size, storage_ + sizeof(char*), sizeof(size));
+        return std::string_view(heap_data(), size);
+    }
+
+private:
+    static constexpr size_t kInlineCapacity = 23;
+    static constexpr size_t kTag = 23;
+    static constexpr char kHeap = static_cast<char>(0xFF);
+
+    char* heap_data() const {
+        char* heap;
+        std::memcpy(&heap, storage_, sizeof(heap));
+        return heap;
+    }
+
+    char storage_[24];
+};
+
+} // namespace flat_map_detail
+
+template <typename V>
+class FlatHashMap {
+public:
+    FlatHashMap() = default;
+    FlatHashMap(const FlatHashMap&) = delete;
+    FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+    FlatHashMap(FlatHashMap&& other) noexcept { swap(other); }
+    FlatHashMap& operator=(FlatHashMap&& other) noexcept {
+        FlatHashMap(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~FlatHashMap() {
+        destroy_slots();
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+
+    V* find(std::string_view key) {
+        size_t index = find_index(key, hash_of(key));
+        return index == npos ? nullptr : &slots_[index].value;
+    }
+
+    const V* find(std::string_view key) const {
+        return const_cast<FlatHashMap*>(this)->find(key);
+    }
+
+    // Inserts key, which must not be present, and returns its value
+    V& emplace(std::string_view key, V value) {
+        size_t hash = hash_of(key);
+        if (growth_left_ == 0) {
+            grow();
+        }
+        size_t index = find_insert_slot(hash);
+        if (ctrl_[index] == flat_map_detail::kEmpty) {
+            growth_left_--;
+        }
+        set_ctrl(index, h2(hash));
+        new (&slots_[index]) Slot{flat_map_detail::InlineKey(key), std::move(value)};
+        size_++;
+        return slots_[index].value;
+    }
+
+    bool erase(std::string_view key) {
+        size_t index = find_index(key, hash_of(key));
+        if (index == npos) {
+            return false;
+        }
+        slots_[index].~Slot();
+        // A tombstone keeps later probes going; it is reused by inserts and dropped on rehash
+        set_ctrl(index, flat_map_detail::kDeleted);
+        size_--;
+        return true;
+    }
+
+    // Calls f(key, value) for every entry, in table order
+    template <typename F>
+    void for_each(F f) const {
+        for (size_t i = 0; i < capacity_; i++) {
+            if (ctrl_[i] >= 0) f(slots_[i].key.view(), slots_[i].value);
+        }
+    }
+
+    // Calls f(key, value) for up to count entries in table order from slot start (taken
+    // modulo the capacity); with a random start this samples entries roughly uniformly
+    template <typename F>
+    void sample(size_t start, size_t count, F f) const {
+        for (size_t i = 0, visited = 0; i < capacity_ && visited < count; i++) {
+            size_t index = (start + i) & (capacity_ - 1);
+            if (ctrl_[index] >= 0) {
+                f(slots_[index].key.view(), slots_[index].value);
+                visited++;
+            }
+        }
+    }
+
+    void reserve(size_t count) {
+        size_t needed = capacity_for(count);
+        if (needed > capacity_) rehash(needed);
+    }
+
+    // Table plus out-of-line key bytes; values' own allocations are not included
+    size_t memory_bytes() const {
+        size_t bytes = capacity_ ? capacity_ * sizeof(Slot) + capacity_ + flat_map_detail::kGroupWidth : 0;
+        for_each([&](std::string_view key, const V&) {
+            if (key.size() > 23) bytes += key.size();
+        });
+        return bytes;
+    }
+
+    void swap(FlatHashMap& other) noexcept {
+        std::swap(ctrl_, other.ctrl_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(size_, other.size_);
+        std::swap(growth_left_, other.growth_left_);
+    }
+
+private:
+    struct Slot {
+        flat_map_detail::InlineKey key;
+        V value;
+    };
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    static constexpr size_t min_capacity = flat_map_detail::kGroupWidth;
+
+    // std::hash's low bits also pick the store shard, so they are remixed (murmur3
+    // finalizer) before being split into H1 and H2
+    static size_t hash_of(std::string_view key) {
+        uint64_t h = std::hash<std::string_view>{}(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return static_cast<size_t>(h);
+    }
+
+    static int8_t h2(size_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+    static size_t h1(size_t hash) { return hash >> 7; }
+
+    static size_t max_load(size_t capacity) { return capacity - capacity / 8; }
+
+    static size_t capacity_for(size_t count) {
+        size_t capacity = min_capacity;
+        while (max_load(capacity) < count) capacity *= 2;
+        return capacity;
+    }
+
+    // The first group's control bytes are mirrored after the last slot, so a group can
+    // be loaded at any position without wrapping
+    void set_ctrl(size_t index, int8_t value) {
+        ctrl_[index] = value;
+        if (index < flat_map_detail::kGroupWidth) ctrl_[capacity_ + index] = value;
+    }
+
+    size_t find_index(std::string_view key, size_t hash) const {
+        if (capacity_ == 0) {
+            return npos;
+        }
+        size_t mask = capacity_ - 1;
+        size_t pos = h1(hash) & mask;
+        for (size_t step = flat_map_detail::kGroupWidth; ; step += flat_map_detail::kGroupWidth) {
+            flat_map_detail::Group group(ctrl_.get() + pos);
+            for (uint32_t match = group.match(h2(hash)); match; match &= match - 1) {
+                size_t index = (pos + flat_map_detail::lowest_bit(match)) & mask;
+                if (slots_[index].key.view() == key) return index;
+            }
+            if (group.match_empty()) {
+                return npos;
+            }
+            pos = (pos + step) & mask;  // Triangular probing visits every group
+        }
+    }
+
+    size_t find_insert_slot(size_t hash) const {
+        size_t mask = capacity_ - 1;
+        size_t pos = h1(hash) & mask;
+        for (size_t step = flat_map_detail::kGroupWidth; ; step += flat_map_detail::kGroupWidth) {
+            flat_map_detail::Group group(ctrl_.get() + pos);
+            if (uint32_t match = group.match_empty_or_deleted()) {
+                return (pos + flat_map_detail::lowest_bit(match)) & mask;
+            }
+            pos = (pos + step) & mask;
+        }
+    }
+
+    void grow() {
+        // Mostly tombstones: rebuilding at the same size is enough
+        if (capacity_ && size_ <= max_load(capacity_) / 2) {
+            rehash(capacity_);
+        } else {
+            rehash(capacity_ ? capacity_ * 2 : min_capacity);
+        }
+    }
+
+    void rehash(size_t new_capacity) {
+        FlatHashMap old;
+        swap(old);
+
+        capacity_ = new_capacity;
+        ctrl_.reset(new int8_t[capacity_ + flat_map_detail::kGroupWidth]);
+        std::memset(ctrl_.get(), flat_map_detail::kEmpty, capacity_ + flat_map_detail::kGroupWidth);
+        slots_ = static_cast<Slot*>(::operator new(capacity_ * sizeof(Slot), std::align_val_t(alignof(Slot))));
+        growth_left_ = max_load(capacity_);
+
+        for (size_t i = 0; i < old.capacity_; i++) {
+            if (old.ctrl_[i] < 0) continue;
+            Slot& slot = old.slots_[i];
+            size_t hash = hash_of(slot.key.view());
+            size_t index = find_insert_slot(hash);
+            set_ctrl(index, h2(hash));
+            new (&slots_[index]) Slot{std::move(slot.key), std::move(slot.value)};
+            growth_left_--;
+            size_++;
+        }
+    }
+
+    void destroy_slots() {
+        if (!slots_) return;
+        for (size_t i = 0; i < capacity_; i++) {
+            if (ctrl_[i] >= 0) slots_[i].~Slot();
+        }
+        ::operator delete(slots_, std::align_val_t(alignof(Slot)));
+        slots_ = nullptr;
+    }
+
+    std::unique_ptr<int8_t[]> ctrl_;
+    Slot* slots_ = nullptr;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    size_t growth_left_ = 0;
+};
+
+#endif // FLAT_HASH_MAP_HPP
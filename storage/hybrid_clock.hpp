@@ -0,0 +1,78 @@
+#ifndef HYBRID_CLOCK_HPP
+#define HYBRID_CLOCK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Hybrid logical clock for write timestamps, packed into one uint64:
+//
+//   bits 63..20  wall-clock milliseconds (44 bits, good until the year 2527)
+//   bits 19..8   logical counter (12 bits)
+//   bits  7..0   node id
+//
+// Packed this way, plain integer comparison orders by physical time, then counter, then
+// node. Every timestamp a clock issues is larger than the last one it issued or observed,
+// even within one millisecond or if the wall clock steps back. Two nodes never issue the
+// same timestamp, so last-write-wins never has to break a tie between different writes.
+// Nodes observe the timestamps of writes they receive, so a write made after seeing
+// another one is ordered after it however far apart the two nodes' clocks are. No extra
+// messages are needed: the timestamp travels with the write.
+//
+// A counter that overflows carries into the millisecond bits, so the clock never stalls;
+// it runs at most a little ahead of the wall clock until the wall clock catches up.
+class HybridClock {
+public:
+    static constexpr unsigned node_bits = 8;
+    static constexpr unsigned logical_bits = 12;
+    static constexpr unsigned physical_shift = node_bits + logical_bits;
+    // An observed timestamp further ahead of the local wall clock than this is not
+    // followed, so one node with a bad clock cannot drag the others' clocks along
+    static constexpr uint64_t max_drift_ms = 60 * 1000;
+
+    // Wall-clock milliseconds of a timestamp
+    static constexpr uint64_t physical_ms(uint64_t timestamp) { return timestamp >> physical_shift; }
+
+    // The smallest timestamp at wall-clock time ms
+    static constexpr uint64_t from_ms(uint64_t ms) { return ms << physical_shift; }
+
+    static uint64_t wall_clock_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void set_node_id(uint8_t node_id) { node_id_.store(node_id, std::memory_order_relaxed); }
+    uint8_t node_id() const { return node_id_.load(std::memory_order_relaxed); }
+
+    // A timestamp for a new local write
+    uint64_t now() {
+        uint64_t physical = from_ms(wall_clock_ms()) >> node_bits;
+        uint64_t last = last_.load(std::memory_order_relaxed);
+        uint64_t next;
+        do {
+            next = physical > last ? physical : last + 1;
+        } while (!last_.compare_exchange_weak(last, next, std::memory_order_relaxed));
+        return (next << node_bits) | node_id();
+    }
+
+    // A timestamp from another node this far ahead is not one the clock could follow.
+    // Writes carrying one are refused: taken in, they would win over every local write to
+    // their key until the wall clock caught up.
+    static bool too_far_ahead(uint64_t timestamp) {
+        return physical_ms(timestamp) > wall_clock_ms() + max_drift_ms;
+    }
+
+    // Moves the clock past a timestamp received from another node or read back from disk
+    void observe(uint64_t timestamp) {
+        uint64_t seen = timestamp >> node_bits;
+        uint64_t last = last_.load(std::memory_order_relaxed);
+        while (last < seen && !last_.compare_exchange_weak(last, seen, std::memory_order_relaxed)) {
+        }
+    }
+
+private:
+    std::atomic<uint64_t> last_{0};  // Last timestamp issued or observed, without the node id
+    std::atomic<uint8_t> node_id_{0};
+};
+
+#endif // HYBRID_CLOCK_HPP
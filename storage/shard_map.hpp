@@ -0,0 +1,84 @@
+#ifndef SHARD_MAP_HPP
+#define SHARD_MAP_HPP
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "flat_hash_map.hpp"
+
+// The map behind each KeyValueStore shard. Both backends expose the same small API:
+//
+//   V* find(key)              nullptr if absent
+//   V& emplace(key, value)    key must be absent
+//   bool erase(key)
+//   for_each(f)               f(std::string_view key, const V& value)
+//   sample(start, count, f)   f for up to count entries, beginning at a position
+//                             derived from start
+//   size(), reserve(n)
+//
+// std::unordered_map is the default; configuring with -DKV_USE_FLAT_MAP=ON switches
+// every shard to the open-addressing FlatHashMap.
+template <typename V>
+class UnorderedShardMap {
+public:
+    V* find(std::string_view key) {
+        auto it = map_.find(key);
+        return it == map_.end() ? nullptr : &it->second;
+    }
+
+    const V* find(std::string_view key) const {
+        auto it = map_.find(key);
+        return it == map_.end() ? nullptr : &it->second;
+    }
+
+    V& emplace(std::string_view key, V value) {
+        return map_.emplace(std::string(key), std::move(value)).first->second;
+    }
+
+    bool erase(std::string_view key) {
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            return false;
+        }
+        map_.erase(it);
+        return true;
+    }
+
+    template <typename F>
+    void for_each(F f) const {
+        for (const auto& [key, value] : map_) f(std::string_view(key), value);
+    }
+
+    template <typename F>
+    void sample(size_t start, size_t count, F f) const {
+        size_t buckets = map_.bucket_count();
+        for (size_t i = 0, visited = 0; i < buckets && visited < count; i++) {
+            size_t bucket = (start + i) % buckets;
+            for (auto it = map_.begin(bucket); it != map_.end(bucket) && visited < count; ++it, ++visited) {
+                f(std::string_view(it->first), it->second);
+            }
+        }
+    }
+
+    size_t size() const { return map_.size(); }
+    void reserve(size_t count) { map_.reserve(count); }
+
+private:
+    struct Hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+
+    std::unordered_map<std::string, V, Hash, std::equal_to<>> map_;
+};
+
+#ifdef KV_USE_FLAT_MAP
+template <typename V>
+using ShardMap = FlatHashMap<V>;
+#else
+template <typename V>
+using ShardMap = UnorderedShardMap<V>;
+#endif
+
+#endif // SHARD_MAP_HPP
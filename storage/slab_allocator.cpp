@@ -0,0 +1,222 @@
+#include "slab_allocator.hpp"
+#include <algorithm>
+#include <new>
+
+namespace {
+
+constexpr size_t slab_class_count = SlabAllocator::class_count - 1;
+
+// 16..128 in steps of 16, then eight evenly spaced sizes per doubling up to 8192,
+// so past 128 bytes rounding wastes at most 1/9 of a chunk
+constexpr std::array<size_t, slab_class_count> chunk_sizes = [] {
+    std::array<size_t, slab_class_count> sizes{};
+    size_t index = 0;
+    for (size_t size = 16; size <= 128; size += 16) sizes[index++] = size;
+    for (size_t base = 128; base < SlabAllocator::max_chunk_size; base *= 2) {
+        for (size_t step = 1; step <= 8; step++) sizes[index++] = base + base / 8 * step;
+    }
+    return sizes;
+}();
+
+static_assert(chunk_sizes.back() == SlabAllocator::max_chunk_size);
+
+// Class of every 16-byte-rounded size, so lookup is one load
+constexpr std::array<uint8_t, SlabAllocator::max_chunk_size / 16 + 1> class_by_size = [] {
+    std::array<uint8_t, SlabAllocator::max_chunk_size / 16 + 1> table{};
+    size_t size_class = 0;
+    for (size_t units = 0; units < table.size(); units++) {
+        while (chunk_sizes[size_class] < units * 16) size_class++;
+        table[units] = static_cast<uint8_t>(size_class);
+    }
+    return table;
+}();
+
+// Single writer per counter, so no read-modify-write is needed
+void add(std::atomic<int64_t>& counter, int64_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+} // namespace
+
+SlabAllocator& SlabAllocator::instance() {
+    // Never destroyed: values may be released by static and thread_local destructors
+    // that run after any static allocator would be gone
+    static SlabAllocator* allocator = new SlabAllocator();
+    return *allocator;
+}
+
+SlabAllocator::SlabAllocator() = default;
+
+size_t SlabAllocator::class_of(size_t bytes) {
+    return bytes > max_chunk_size ? large_class : class_by_size[(bytes + 15) / 16];
+}
+
+size_t SlabAllocator::chunk_size_of(size_t bytes) {
+    size_t size_class = class_of(bytes);
+    return size_class == large_class ? bytes : chunk_sizes[size_class];
+}
+
+// Chunks moved between a thread cache and the shared list at a time: a quarter slab,
+// between 2 and 64 chunks
+size_t SlabAllocator::batch_of(size_t size_class) {
+    return std::clamp<size_t>(slab_size / chunk_sizes[size_class] / 4, 2, 64);
+}
+
+SlabAllocator::ThreadCache& SlabAllocator::local_cache() {
+    thread_local ThreadCache cache;
+    if (!cache.registered) {
+        cache.registered = true;
+        thread_local Retirer retirer;
+        retirer.cache = &cache;
+        std::lock_guard<std::mutex> lock(registry_mutex_);
+        caches_.push_back(&cache);
+    }
+    return cache;
+}
+
+SlabAllocator::Retirer::~Retirer() {
+    if (cache) SlabAllocator::instance().retire_cache(*cache);
+}
+
+void* SlabAllocator::allocate(size_t bytes) {
+    size_t size_class = class_of(bytes);
+    ThreadCache& cache = local_cache();
+    if (cache.retired) {
+        classes_[size_class].chunks.fetch_add(1, std::memory_order_relaxed);
+        classes_[size_class].bytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+        return size_class == large_class ? ::operator new(bytes) : allocate_central(size_class);
+    }
+    add(cache.chunks[size_class], 1);
+    add(cache.bytes[size_class], static_cast<int64_t>(bytes));
+    if (size_class == large_class) {
+        return ::operator new(bytes);
+    }
+    if (!cache.free[size_class]) {
+        refill(cache, size_class);
+    }
+    FreeChunk* chunk = cache.free[size_class];
+    cache.free[size_class] = chunk->next;
+    cache.cached[size_class]--;
+    return chunk;
+}
+
+void SlabAllocator::deallocate(void* pointer, size_t bytes) {
+    size_t size_class = class_of(bytes);
+    ThreadCache& cache = local_cache();
+    if (cache.retired) {
+        classes_[size_class].chunks.fetch_sub(1, std::memory_order_relaxed);
+        classes_[size_class].bytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+        if (size_class == large_class) {
+            ::operator delete(pointer);
+        } else {
+            deallocate_central(pointer, size_class);
+        }
+        return;
+    }
+    add(cache.chunks[size_class], -1);
+    add(cache.bytes[size_class], -static_cast<int64_t>(bytes));
+    if (size_class == large_class) {
+        ::operator delete(pointer);
+        return;
+    }
+    FreeChunk* chunk = static_cast<FreeChunk*>(pointer);
+    chunk->next = cache.free[size_class];
+    cache.free[size_class] = chunk;
+    // Past two batches, give one back so a thread that only frees does not hoard chunks
+    size_t batch = batch_of(size_class);
+    if (++cache.cached[size_class] > 2 * batch) {
+        release(cache, size_class, static_cast<uint32_t>(batch));
+    }
+}
+
+void SlabAllocator::refill(ThreadCache& cache, size_t size_class) {
+    CentralClass& central = classes_[size_class];
+    size_t batch = batch_of(size_class);
+    std::lock_guard<std::mutex> lock(central.mutex);
+    if (!central.free) {
+        size_t chunk_size = chunk_sizes[size_class];
+        char* slab = static_cast<char*>(::operator new(slab_size));
+        central.slabs.push_back(slab);
+        central.reserved.fetch_add(slab_size, std::memory_order_relaxed);
+        for (size_t offset = slab_size / chunk_size * chunk_size; offset > 0; offset -= chunk_size) {
+            FreeChunk* chunk = reinterpret_cast<FreeChunk*>(slab + offset - chunk_size);
+            chunk->next = central.free;
+            central.free = chunk;
+        }
+    }
+    for (size_t i = 0; i < batch && central.free; i++) {
+        FreeChunk* chunk = central.free;
+        central.free = chunk->next;
+        chunk->next = cache.free[size_class];
+        cache.free[size_class] = chunk;
+        cache.cached[size_class]++;
+    }
+}
+
+void SlabAllocator::release(ThreadCache& cache, size_t size_class, uint32_t count) {
+    CentralClass& central = classes_[size_class];
+    std::lock_guard<std::mutex> lock(central.mutex);
+    for (uint32_t i = 0; i < count && cache.free[size_class]; i++) {
+        FreeChunk* chunk = cache.free[size_class];
+        cache.free[size_class] = chunk->next;
+        cache.cached[size_class]--;
+        chunk->next = central.free;
+        central.free = chunk;
+    }
+}
+
+void* SlabAllocator::allocate_central(size_t size_class) {
+    // A throwaway cache: one refill, keep the first chunk, hand the rest back
+    ThreadCache scratch;
+    refill(scratch, size_class);
+    FreeChunk* chunk = scratch.free[size_class];
+    scratch.free[size_class] = chunk->next;
+    scratch.cached[size_class]--;
+    release(scratch, size_class, scratch.cached[size_class]);
+    return chunk;
+}
+
+void SlabAllocator::deallocate_central(void* pointer, size_t size_class) {
+    CentralClass& central = classes_[size_class];
+    std::lock_guard<std::mutex> lock(central.mutex);
+    FreeChunk* chunk = static_cast<FreeChunk*>(pointer);
+    chunk->next = central.free;
+    central.free = chunk;
+}
+
+void SlabAllocator::retire_cache(ThreadCache& cache) {
+    for (size_t size_class = 0; size_class < large_class; size_class++) {
+        release(cache, size_class, cache.cached[size_class]);
+    }
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    for (size_t size_class = 0; size_class < class_count; size_class++) {
+        classes_[size_class].chunks.fetch_add(cache.chunks[size_class].load(std::memory_order_relaxed),
+                                              std::memory_order_relaxed);
+        classes_[size_class].bytes.fetch_add(cache.bytes[size_class].load(std::memory_order_relaxed),
+                                             std::memory_order_relaxed);
+    }
+    caches_.erase(std::find(caches_.begin(), caches_.end(), &cache));
+    cache.retired = true;
+}
+
+std::vector<SlabAllocator::ClassStats> SlabAllocator::stats() const {
+    std::vector<ClassStats> result(class_count);
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    for (size_t size_class = 0; size_class < class_count; size_class++) {
+        const CentralClass& central = classes_[size_class];
+        int64_t chunks = central.chunks.load(std::memory_order_relaxed);
+        int64_t bytes = central.bytes.load(std::memory_order_relaxed);
+        for (const ThreadCache* cache : caches_) {
+            chunks += cache->chunks[size_class].load(std::memory_order_relaxed);
+            bytes += cache->bytes[size_class].load(std::memory_order_relaxed);
+        }
+        ClassStats& stats = result[size_class];
+        stats.chunk_size = size_class == large_class ? 0 : chunk_sizes[size_class];
+        stats.chunks = static_cast<uint64_t>(std::max<int64_t>(chunks, 0));
+        stats.bytes_requested = static_cast<uint64_t>(std::max<int64_t>(bytes, 0));
+        stats.bytes_allocated = size_class == large_class ? stats.bytes_requested : stats.chunks * stats.chunk_size;
+        stats.bytes_reserved = size_class == large_class ? stats.bytes_requested
+                                                         : central.reserved.load(std::memory_order_relaxed);
+    }
+    return result;
+}
@@ -0,0 +1,101 @@
+#ifndef SLAB_ALLOCATOR_HPP
+#define SLAB_ALLOCATOR_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Size-class allocator for stored values.
+//
+// Requests up to max_chunk_size bytes are rounded up to one of a fixed set of chunk
+// sizes (16-byte steps to 128, then eight steps per doubling) and carved from 64KB
+// slabs. Freed chunks are kept on their class's free list and handed out again, so a
+// key rewritten for days reuses the same few chunk sizes instead of scattering
+// odd-sized holes through the global heap. Slabs are never returned: memory reserved
+// by a class stays bounded by that class's peak use. Larger requests go to
+// ::operator new and are accounted for as one "large" class.
+//
+// Each thread keeps a small cache of free chunks per class and only takes a class
+// lock to move a batch between its cache and the shared free list. Byte counts are
+// kept per thread as well and summed on demand by stats().
+class SlabAllocator {
+public:
+    static constexpr size_t slab_size = 64 * 1024;
+    static constexpr size_t max_chunk_size = 8192;
+    static constexpr size_t class_count = 57;  // 56 slab classes plus the large class
+    static constexpr size_t large_class = class_count - 1;
+
+    struct ClassStats {
+        size_t chunk_size;         // 0 for the large class
+        uint64_t chunks;           // Live allocations
+        uint64_t bytes_requested;  // Sum of their requested sizes
+        uint64_t bytes_allocated;  // chunks * chunk_size (requested bytes for large)
+        uint64_t bytes_reserved;   // Slab memory held by the class, free chunks included
+    };
+
+    static SlabAllocator& instance();
+
+    void* allocate(size_t bytes);
+    void deallocate(void* pointer, size_t bytes);
+
+    // One entry per class, smallest first and the large class last
+    std::vector<ClassStats> stats() const;
+
+    static size_t chunk_size_of(size_t bytes);
+
+private:
+    // Trivially destructible, so a value freed by a later thread_local destructor still
+    // finds valid state: once retired, the thread goes straight to the shared lists.
+    // Counts are signed because a thread may free what another one allocated.
+    struct ThreadCache {
+        struct FreeChunk {
+            FreeChunk* next;
+        };
+        std::array<FreeChunk*, class_count> free{};
+        std::array<uint32_t, class_count> cached{};
+        std::array<std::atomic<int64_t>, class_count> chunks{};
+        std::array<std::atomic<int64_t>, class_count> bytes{};
+        bool registered = false;
+        bool retired = false;
+    };
+
+    // Hands a thread's cache back when the thread exits
+    struct Retirer {
+        ThreadCache* cache = nullptr;
+        ~Retirer();
+    };
+
+    using FreeChunk = ThreadCache::FreeChunk;
+
+    struct alignas(64) CentralClass {
+        std::mutex mutex;
+        FreeChunk* free = nullptr;
+        std::vector<void*> slabs;
+        std::atomic<uint64_t> reserved{0};
+        // Counts of threads that have exited, and of frees/allocations made after a
+        // thread's cache was retired
+        std::atomic<int64_t> chunks{0};
+        std::atomic<int64_t> bytes{0};
+    };
+
+    SlabAllocator();
+
+    static size_t class_of(size_t bytes);
+    static size_t batch_of(size_t size_class);
+    ThreadCache& local_cache();
+
+    void refill(ThreadCache& cache, size_t size_class);
+    void release(ThreadCache& cache, size_t size_class, uint32_t count);
+    void* allocate_central(size_t size_class);
+    void deallocate_central(void* pointer, size_t size_class);
+    void retire_cache(ThreadCache& cache);
+
+    std::array<CentralClass, class_count> classes_;
+    mutable std::mutex registry_mutex_;
+    std::vector<ThreadCache*> caches_;
+};
+
+#endif // SLAB_ALLOCATOR_HPP
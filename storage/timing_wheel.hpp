@@ -0,0 +1,143 @@
+#ifndef TIMING_WHEEL_HPP
+#define TIMING_WHEEL_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Hierarchical timing wheel of key expiry times, in wall-clock milliseconds.
+//
+// Four wheels of 64 slots each, ticking every tick_ms: the first covers the next
+// 640 ms one tick per slot, each further wheel 64 times the span of the one below it
+// (41 s, 44 min, 46 h). A timer goes into the slot of the coarsest wheel it needs.
+// When a wheel below completes a turn, the next slot of the wheel above is emptied
+// into the finer wheels, so every timer is touched once per wheel on its way down and
+// scheduling or firing costs O(1) however many keys are waiting. Timers further out
+// than the top wheel reaches wait in its last slot and are placed again on the way down.
+//
+// Advancing skips over stretches in which nothing can fire or cascade, so a wheel
+// may also be moved far ahead in one call; KeyValueStore does that with the
+// tombstone wheel when replicas agree on a newer collection horizon.
+//
+// Timers cannot be cancelled. A key written again with a new TTL simply gets a second
+// timer; the owner checks the key's current expiry time when one fires and ignores it
+// if it no longer applies. Not thread-safe: KeyValueStore keeps one wheel per shard
+// under the shard lock.
+class TimingWheel {
+public:
+    static constexpr uint64_t tick_ms = 10;
+    static constexpr size_t slot_bits = 6;
+    static constexpr size_t slots = size_t(1) << slot_bits;
+    static constexpr size_t wheels = 4;
+
+    // Queues key to fire once now passes expire_at
+    void schedule(std::string_view key, uint64_t expire_at, uint64_t now) {
+        if (size_ == 0) {
+            tick_ = now / tick_ms;
+        }
+        // Slot tick_ of the first wheel has already fired
+        place(Timer{std::string(key), expire_at}, tick_ + 1);
+        size_++;
+    }
+
+    // Calls on_due(key, expire_at) for every timer with expire_at <= now
+    template <typename OnDue>
+    void advance(uint64_t now, OnDue on_due) {
+        uint64_t target = now / tick_ms;
+        if (size_ == 0) {
+            tick_ = std::max(tick_, target);
+            return;
+        }
+        while (tick_ < target) {
+            // With the finer wheels empty, nothing happens before the next slot of the
+            // lowest occupied wheel comes up
+            size_t lowest = 0;
+            while (lowest < wheels && counts_[lowest] == 0) lowest++;
+            if (lowest == wheels) {
+                tick_ = target;
+                break;
+            }
+            if (lowest > 0) {
+                uint64_t next = ((tick_ >> (slot_bits * lowest)) + 1) << (slot_bits * lowest);
+                if (next > target) {
+                    tick_ = target;
+                    break;
+                }
+                tick_ = next - 1;
+            }
+            tick_++;
+            // Coarsest first, so timers cascading from the top can land in a wheel
+            // that is cascaded next
+            for (size_t wheel = wheels - 1; wheel > 0; wheel--) {
+                if ((tick_ & ((uint64_t(1) << (slot_bits * wheel)) - 1)) == 0) {
+                    cascade(wheel);
+                }
+            }
+            std::vector<Timer> due;
+            due.swap(slot(0, tick_));
+            counts_[0] -= due.size();
+            for (auto& timer : due) {
+                if (tick_of(timer.expire_at) <= tick_) {
+                    size_--;
+                    on_due(std::string_view(timer.key), timer.expire_at);
+                } else {
+                    place(std::move(timer), tick_ + 1);  // Was beyond the top wheel's reach
+                }
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    struct Timer {
+        std::string key;
+        uint64_t expire_at;
+    };
+
+    // Rounded up, so a timer's tick is never reached before expire_at has passed
+    static uint64_t tick_of(uint64_t expire_at) {
+        return (expire_at + tick_ms - 1) / tick_ms;
+    }
+
+    std::vector<Timer>& slot(size_t wheel, uint64_t tick) {
+        return slots_[wheel * slots + ((tick >> (slot_bits * wheel)) & (slots - 1))];
+    }
+
+    // earliest is the first tick that still has to be processed
+    void place(Timer timer, uint64_t earliest) {
+        uint64_t tick = std::max(tick_of(timer.expire_at), earliest);
+        uint64_t delta = tick - tick_;
+        size_t wheel = 0;
+        while (wheel + 1 < wheels && delta >= (uint64_t(1) << (slot_bits * (wheel + 1)))) {
+            wheel++;
+        }
+        if (delta >= (uint64_t(1) << (slot_bits * wheels))) {
+            tick = tick_ + (uint64_t(1) << (slot_bits * wheels)) - 1;
+        }
+        slot(wheel, tick).push_back(std::move(timer));
+        counts_[wheel]++;
+    }
+
+    // Moves the slot of wheel that starts at tick_ into the finer wheels
+    void cascade(size_t wheel) {
+        std::vector<Timer> timers;
+        timers.swap(slot(wheel, tick_));
+        counts_[wheel] -= timers.size();
+        for (auto& timer : timers) {
+            place(std::move(timer), tick_);
+        }
+    }
+
+    std::array<std::vector<Timer>, wheels * slots> slots_;
+    std::array<size_t, wheels> counts_{};  // Timers per wheel
+    uint64_t tick_ = 0;  // Last tick processed
+    size_t size_ = 0;
+};
+
+#endif // TIMING_WHEEL_HPP
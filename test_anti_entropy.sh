@@ -16,9 +16,9 @@ pass() { echo -e "\033[32mPASS:\033[0m $1"; }
 fail() { echo -e "\033[31mFAIL:\033[0m $1"; }
 
 # Test 1: SET on node1, GET on node2
-echo "SET A 1" | nc localhost 5008 > /dev/null
+echo "SET A 1" | nc -w 1 localhost 5008 > /dev/null
 sleep 1
-RESULT=$(echo "GET A" | nc localhost 5009)
+RESULT=$(echo "GET A" | nc -w 1 localhost 5009)
 if [ "$RESULT" = "1" ]; then
     pass "SET A=1 on node1, GET on node2"
 else
@@ -30,9 +30,9 @@ echo "Waiting for anti-entropy synchronization..."
 sleep 6
 
 # Test 2: SET on node2, GET on node1
-echo "SET B 2" | nc localhost 5009 > /dev/null
+echo "SET B 2" | nc -w 1 localhost 5009 > /dev/null
 sleep 1
-RESULT=$(echo "GET B" | nc localhost 5008)
+RESULT=$(echo "GET B" | nc -w 1 localhost 5008)
 if [ "$RESULT" = "2" ]; then
     pass "SET B=2 on node2, GET on node1"
 else
@@ -44,7 +44,7 @@ echo "Waiting for anti-entropy synchronization..."
 sleep 6
 
 # Test 3: GET on node1 for key A (should still be 1)
-RESULT=$(echo "GET A" | nc localhost 5008)
+RESULT=$(echo "GET A" | nc -w 1 localhost 5008)
 if [ "$RESULT" = "1" ]; then
     pass "GET A on node1 after anti-entropy"
 else
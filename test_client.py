@@ -9,10 +9,15 @@ and includes automated test scenarios to validate system behavior.
 import socket
 import time
 import sys
+import os
 import argparse
+import shutil
+import subprocess
+import tempfile
 import threading
 import random
 import string
+import struct
 
 # Default node addresses
 NODE1 = ('localhost', 5008)
@@ -33,15 +38,17 @@ class KVClient:
             with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
                 sock.settimeout(self.timeout)
                 sock.connect((self.host, self.port))
-                sock.sendall(command.encode())
+                sock.sendall((command + "\n").encode())
                 response = sock.recv(1024).decode().strip()
                 return response
         except socket.error as e:
             print(f"Socket error: {e}")
             return None
     
-    def set(self, key, value):
-        """Set a key-value pair."""
+    def set(self, key, value, ex=None):
+        """Set a key-value pair, expiring after ex seconds if given."""
+        if ex is not None:
+            return self.send_command(f"SET {key} {value} EX {ex}")
         return self.send_command(f"SET {key} {value}")
     
     def get(self, key):
@@ -52,6 +59,105 @@ class KVClient:
         """Delete a key."""
         return self.send_command(f"DEL {key}")
 
+    def expire(self, key, seconds):
+        """Expire a key after the given number of seconds."""
+        return self.send_command(f"EXPIRE {key} {seconds}")
+
+    def cluster(self):
+        """Return CLUSTER as {"host:port": (node_id, state)}, this node's state being "self"."""
+        members = {}
+        for item in (self.send_command("CLUSTER") or "").split(";"):
+            if item:
+                node_id, address, state = item.split(",")
+                members[address] = (int(node_id), state)
+        return members
+
+    def get_all(self):
+        """Return GET_ALL as {key: timestamp}: every key this node holds."""
+        return {key: int(ts) for key, _, ts in
+                (item.rpartition(":") for item in self._read_line("GET_ALL").split(";") if item)}
+
+    def _read_line(self, command):
+        """Send a command and read its whole reply line, however long."""
+        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
+            sock.settimeout(self.timeout)
+            sock.connect((self.host, self.port))
+            sock.sendall((command + "\n").encode())
+            response = b""
+            while not response.endswith(b"\n"):
+                chunk = sock.recv(65536)
+                if not chunk:
+                    break
+                response += chunk
+        return response.decode().strip()
+
+    def stats(self):
+        """Return STATS as {"memory": (used, max, evicted), chunk_size: (chunks, requested, allocated, reserved)}."""
+        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
+            sock.settimeout(self.timeout)
+            sock.connect((self.host, self.port))
+            sock.sendall(b"STATS\n")
+            response = b""
+            while not response.endswith(b"\n"):
+                chunk = sock.recv(4096)
+                if not chunk:
+                    break
+                response += chunk
+        classes = {}
+        for item in response.decode().strip().split(";"):
+            if item:
+                size, *counts = item.split(":")
+                classes[size] = tuple(int(count) for count in counts)
+        return classes
+
+
+class BinaryKVClient:
+    """Client speaking the length-prefixed binary protocol over one persistent connection."""
+
+    OP_GET, OP_SET, OP_DEL, OP_GET_ALL = 1, 2, 3, 4
+    STATUS_OK, STATUS_NOT_FOUND, STATUS_ERROR, STATUS_MORE, STATUS_MOVED = 0, 1, 2, 3, 4
+    FLAG_PROPAGATED = 0x01
+
+    def __init__(self, host='localhost', port=5008, timeout=2):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.sendall(b"PROTOCOL BINARY\n")
+        if self._recv_exact(3) != b"OK\n":
+            raise RuntimeError("binary protocol negotiation failed")
+
+    def _recv_exact(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError("connection closed")
+            data += chunk
+        return data
+
+    def request(self, opcode, key, value=b"", timestamp=0, flags=0):
+        """Send one frame and return (status, payload)."""
+        key, value = key.encode(), value.encode() if isinstance(value, str) else value
+        self.sock.sendall(struct.pack(">BBHIQ", opcode, flags, len(key), len(value), timestamp) + key + value)
+        status, _, _, _, length = struct.unpack(">BBBBI", self._recv_exact(8))
+        return status, self._recv_exact(length)
+
+    def get_all(self):
+        """Read a streamed GET_ALL reply and return {key: timestamp}."""
+        key_timestamps = {}
+        self.sock.sendall(struct.pack(">BBHIQ", self.OP_GET_ALL, 0, 0, 0, 0))
+        while True:
+            status, _, _, _, length = struct.unpack(">BBBBI", self._recv_exact(8))
+            chunk, pos = self._recv_exact(length), 0
+            while pos < length:
+                key_len = struct.unpack(">H", chunk[pos:pos + 2])[0]
+                key = chunk[pos + 2:pos + 2 + key_len].decode()
+                key_timestamps[key] = struct.unpack(">Q", chunk[pos + 2 + key_len:pos + 10 + key_len])[0]
+                pos += 10 + key_len
+            if status != self.STATUS_MORE:
+                return key_timestamps
+
+    def close(self):
+        self.sock.close()
+
 
 class TestRunner:
     """Runs automated tests against the distributed KV store."""
@@ -99,7 +205,88 @@ class TestRunner:
         result = self.client1.get(test_key)
         self._assert(result == "" or "not found" in result.lower(), 
                    f"GET after DELETE returned: {result}")
+
+        # A key longer than the binary protocol's u16 length could not be replicated
+        result = self.client1.set("k" * 70000, test_val)
+        self._assert(result == "ERROR: Key too long", f"SET with a 70000-byte key returned: {result}")
     
+    def test_binary_protocol(self):
+        """Test SET/GET/DEL over the binary protocol, including values with spaces."""
+        print("\n=== Testing Binary Protocol ===")
+
+        client = BinaryKVClient(host=NODE1[0], port=NODE1[1])
+        try:
+            test_key = self._random_key("binary_")
+            test_val = "value with spaces\tand tabs"
+
+            status, _ = client.request(BinaryKVClient.OP_SET, test_key, test_val)
+            self._assert(status == BinaryKVClient.STATUS_OK, f"Binary SET returned status {status}")
+
+            status, payload = client.request(BinaryKVClient.OP_GET, test_key)
+            self._assert(payload.decode() == test_val, f"Binary GET returned: {payload!r}")
+
+            key_timestamps = client.get_all()
+            self._assert(test_key in key_timestamps, f"Streamed GET_ALL lists {test_key}")
+
+            status, _ = client.request(BinaryKVClient.OP_DEL, test_key)
+            self._assert(status == BinaryKVClient.STATUS_OK, f"Binary DEL returned status {status}")
+
+            status, _ = client.request(BinaryKVClient.OP_GET, test_key)
+            self._assert(status == BinaryKVClient.STATUS_NOT_FOUND, f"Binary GET after DEL returned status {status}")
+        finally:
+            client.close()
+
+    def test_cluster_membership(self):
+        """Test that each node lists itself and has found the other alive by gossip."""
+        print("\n=== Testing Cluster Membership ===")
+
+        members1 = self.client1.cluster()
+        members2 = self.client2.cluster()
+        address1 = f"127.0.0.1:{NODE1[1]}"
+        address2 = f"127.0.0.1:{NODE2[1]}"
+        self._assert(members1.get(address1, (0, ""))[1] == "self", f"Node 1 lists itself: {members1}")
+        self._assert(members1.get(address2, (0, ""))[1] == "alive", f"Node 1 sees Node 2 alive: {members1}")
+        self._assert(members2.get(address1, (0, ""))[1] == "alive", f"Node 2 sees Node 1 alive: {members2}")
+
+    def test_memory_stats(self):
+        """Test that STATS accounts for a stored value in its size class."""
+        print("\n=== Testing Memory Stats ===")
+
+        test_key = self._random_key("stats_")
+        before = self.client1.stats().get("1024", (0, 0, 0, 0))
+        self.client1.set(test_key, "s" * 1000)
+        after = self.client1.stats().get("1024", (0, 0, 0, 0))
+        self._assert(after[0] == before[0] + 1, f"1024-byte class chunks went from {before[0]} to {after[0]}")
+        self._assert(after[3] >= after[2] >= after[1], f"1024-byte class reserved >= allocated >= requested: {after}")
+        used, max_memory, _ = self.client1.stats()["memory"]
+        self._assert(used > 1000 and (max_memory == 0 or used <= max_memory),
+                     f"Store reports {used} bytes used (cap {max_memory})")
+        self.client1.delete(test_key)
+
+    def test_expiry(self):
+        """Test SET ... EX and EXPIRE, and that expired keys are gone on both nodes."""
+        print("\n=== Testing Key Expiry ===")
+
+        ex_key = self._random_key("ttl_")
+        expire_key = self._random_key("ttl_")
+        result = self.client1.set(ex_key, "short_lived", ex=1)
+        self._assert(result == "OK", f"SET with EX returned: {result}")
+        self._assert(self.client1.set(ex_key, "bad", ex=0).startswith("ERROR"), "SET with EX 0 is rejected")
+        self.client2.set(expire_key, "also_short_lived")
+        time.sleep(0.3)
+        result = self.client2.expire(expire_key, 1)
+        self._assert(result == "OK", f"EXPIRE returned: {result}")
+        result = self.client1.expire(self._random_key("ttl_missing_"), 1)
+        self._assert(result.startswith("ERROR"), f"EXPIRE of a missing key returned: {result}")
+        result = self.client2.get(ex_key)
+        self._assert(result == "short_lived", f"Node 2 has the replicated key before it expires: {result}")
+
+        time.sleep(1.5)
+        for client, name in ((self.client1, "Node 1"), (self.client2, "Node 2")):
+            self._assert(client.get(ex_key) == "", f"{name} no longer returns {ex_key}")
+            self._assert(client.get(expire_key) == "", f"{name} no longer returns {expire_key}")
+        self._assert(self.client1.stats().get("expired", (0,))[0] > 0, "STATS counts expired keys")
+
     def test_anti_entropy(self):
         """Test anti-entropy synchronization between nodes."""
         print("\n=== Testing Anti-Entropy Synchronization ===")
@@ -120,6 +307,29 @@ class TestRunner:
         self._assert(result == test_val, 
                    f"Anti-entropy sync: Node 2 returned {result} for key {test_key}")
     
+    def test_delete_sync(self):
+        """Test that a delete reaches a replica through anti-entropy and the value stays gone."""
+        print("\n=== Testing Delete Synchronization ===")
+
+        test_key = self._random_key("del_sync_")
+        self.client1.set(test_key, "doomed")
+        time.sleep(0.5)
+        self._assert(self.client2.get(test_key) == "doomed", "Node 2 has the replicated key")
+
+        # Marked as propagated, so node 1 deletes locally and only anti-entropy can tell node 2
+        client = BinaryKVClient(host=NODE1[0], port=NODE1[1])
+        try:
+            status, _ = client.request(BinaryKVClient.OP_DEL, test_key, flags=BinaryKVClient.FLAG_PROPAGATED)
+            self._assert(status == BinaryKVClient.STATUS_OK, f"Unreplicated DEL returned status {status}")
+        finally:
+            client.close()
+        self._assert(self.client1.stats().get("tombstones", (0, 0))[0] > 0, "STATS counts the tombstone")
+
+        print("Waiting for anti-entropy synchronization (6 seconds)...")
+        time.sleep(6)
+        self._assert(self.client2.get(test_key) == "", f"Node 2 no longer returns {test_key}")
+        self._assert(self.client1.get(test_key) == "", f"Node 1 did not copy {test_key} back")
+
     def test_conflict_resolution(self):
         """Test conflict resolution with concurrent updates."""
         print("\n=== Testing Conflict Resolution ===")
@@ -243,7 +453,12 @@ class TestRunner:
     def run_all_tests(self):
         """Run all test cases."""
         self.test_basic_operations()
+        self.test_binary_protocol()
+        self.test_cluster_membership()
+        self.test_memory_stats()
+        self.test_expiry()
         self.test_anti_entropy()
+        self.test_delete_sync()
         self.test_conflict_resolution()
         self.test_bidirectional_sync()
         self.test_concurrent_updates()
@@ -255,6 +470,255 @@ class TestRunner:
         return self.results['failed'] == 0
 
 
+class ClusterTestRunner(TestRunner):
+    """Starts kv_node clusters from temporary configs and tests write ordering, routing
+    and rebalancing on them."""
+
+    BASE_PORT = 5201
+    NODE_BITS, PHYSICAL_SHIFT = 8, 20  # HybridClock timestamp layout
+
+    def __init__(self, kv_node):
+        self.kv_node = kv_node
+        self.workdir = tempfile.mkdtemp(prefix="kv_cluster_")
+        self.nodes = {}
+        self.results = {'passed': 0, 'failed': 0}
+
+    def _start_node(self, node_id, replication_factor, seed_port, *args):
+        """Start kv_node node_id on BASE_PORT + node_id - 1, passing args after the thread count,
+        and return its client."""
+        port = self.BASE_PORT + node_id - 1
+        config = os.path.join(self.workdir, f"node{node_id}.conf")
+        with open(config, "w") as f:
+            f.write(f"node_id = {node_id}\nport = {port}\nseeds = 127.0.0.1:{seed_port}\n"
+                    f"replication_factor = {replication_factor}\n"
+                    "gossip_interval_ms = 200\nsuspect_after_ms = 1000\ndead_after_ms = 2000\n")
+        log = open(os.path.join(self.workdir, f"node{node_id}.log"), "w")
+        self.nodes[port] = subprocess.Popen([self.kv_node, config, "1", *args], stdout=log, stderr=subprocess.STDOUT)
+        client = KVClient(port=port)
+        self._wait_until(lambda: self._reachable(port), 5)
+        return client
+
+    def _stop_nodes(self):
+        for process in self.nodes.values():
+            process.kill()
+            process.wait()
+        self.nodes.clear()
+
+    @staticmethod
+    def _reachable(port):
+        try:
+            socket.create_connection(("localhost", port), timeout=0.2).close()
+            return True
+        except OSError:
+            return False
+
+    @staticmethod
+    def _wait_until(condition, timeout):
+        """Poll condition until it holds or timeout seconds pass; return whether it held."""
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            if condition():
+                return True
+            time.sleep(0.2)
+        return condition()
+
+    def _converged(self, clients):
+        """Whether every node lists every other one alive."""
+        addresses = {f"127.0.0.1:{client.port}" for client in clients}
+        for client in clients:
+            members = client.cluster()
+            if {a for a, (_, state) in members.items() if state in ("self", "alive")} != addresses:
+                return False
+        return True
+
+    @staticmethod
+    def _routed(clients, command):
+        """Send command to the first node, following one MOVED; return (reply, port served)."""
+        reply = clients[0].send_command(command)
+        if reply and reply.startswith("MOVED "):
+            port = int(reply.rsplit(":", 1)[1])
+            return KVClient(port=port).send_command(command), port
+        return reply, clients[0].port
+
+    def test_hlc_ordering(self):
+        """Test that writes in one millisecond, and writes after seeing a peer's, are ordered."""
+        print("\n=== Testing Hybrid Logical Clock Ordering ===")
+        client1 = self._start_node(1, 2, self.BASE_PORT)
+        client2 = self._start_node(2, 2, self.BASE_PORT)
+        self._assert(self._wait_until(lambda: self._converged([client1, client2]), 10),
+                     "Two-node cluster formed")
+
+        # A pipelined burst lands many writes in the same millisecond
+        keys = [f"hlc_burst_{i:03d}" for i in range(200)]
+        with socket.create_connection(("localhost", client1.port), timeout=2) as sock:
+            sock.sendall("".join(f"SET {key} v\n" for key in keys).encode())
+            replies = b""
+            while replies.count(b"\n") < len(keys):
+                chunk = sock.recv(65536)
+                if not chunk:
+                    break
+                replies += chunk
+        timestamps = [client1.get_all()[key] for key in keys]
+        physical = {ts >> self.PHYSICAL_SHIFT for ts in timestamps}
+        self._assert(all(a < b for a, b in zip(timestamps, timestamps[1:])),
+                     f"{len(keys)} writes in {len(physical)} ms have strictly increasing timestamps")
+        self._assert(all(ts & 0xff == 1 for ts in timestamps), "Timestamps carry the writer's node id")
+
+        # A write made on node 2 after it has seen node 1's wins, whatever the two clocks say
+        key = "hlc_causal"
+        client1.set(key, "first")
+        self._wait_until(lambda: client2.get(key) == "first", 5)
+        result = client2.set(key, "second")
+        self._assert(result == "OK", f"SET after seeing the peer's write returned: {result}")
+        self._wait_until(lambda: client1.get(key) == "second", 5)
+        self._assert(client1.get(key) == "second" and client2.get(key) == "second",
+                     "The later write wins on both nodes")
+        self._assert(client2.get_all()[key] > client1.get_all().get("hlc_burst_199", 0),
+                     "Node 2 stamps past the timestamps it has observed")
+
+        # A peer whose clock runs 5 s ahead: its write is taken, and the next local write
+        # still wins because the local clock followed it
+        binary = BinaryKVClient(port=client1.port)
+        try:
+            now_ms = int(time.time() * 1000)
+            ahead = ((now_ms + 5000) << self.PHYSICAL_SHIFT) | 9
+            status, _ = binary.request(BinaryKVClient.OP_SET, "hlc_skew", "from_peer", ahead,
+                                       BinaryKVClient.FLAG_PROPAGATED)
+            self._assert(status == BinaryKVClient.STATUS_OK, f"Write from a peer 5 s ahead returned status {status}")
+            result = client1.set("hlc_skew", "local")
+            self._assert(result == "OK" and client1.get("hlc_skew") == "local",
+                         f"A local write after it still wins: {result}, {client1.get('hlc_skew')}")
+
+            # One an hour ahead is refused rather than stored
+            rejected = client1.stats().get("rejected", (0,))[0]
+            far_ahead = ((now_ms + 3600 * 1000) << self.PHYSICAL_SHIFT) | 9
+            status, body = binary.request(BinaryKVClient.OP_SET, "hlc_far", "from_peer", far_ahead,
+                                          BinaryKVClient.FLAG_PROPAGATED)
+            self._assert(status == BinaryKVClient.STATUS_ERROR, f"Write from a peer an hour ahead returned {status} {body!r}")
+            self._assert(client1.get("hlc_far") == "", "The refused write is not stored")
+            self._assert(client1.stats().get("rejected", (0,))[0] == rejected + 1, "STATS counts the refused write")
+            result = client1.set("hlc_after", "local")
+            self._assert(result == "OK" and client1.get_all()["hlc_after"] >> self.PHYSICAL_SHIFT < now_ms + 60000,
+                         "The local clock did not follow the refused timestamp")
+
+            # A client's header timestamp is ignored: only propagated writes carry their own
+            status, _ = binary.request(BinaryKVClient.OP_SET, "hlc_client", "v", far_ahead)
+            stamped = client1.get_all().get("hlc_client", 0) >> self.PHYSICAL_SHIFT
+            self._assert(status == BinaryKVClient.STATUS_OK and abs(stamped - now_ms) < 60000,
+                         f"A client write is stamped by the node, not the client ({stamped - now_ms} ms off)")
+        finally:
+            binary.close()
+        self._stop_nodes()
+
+    def test_capped_replica(self):
+        """Test that anti-entropy does not copy evicted keys back into a capped replica."""
+        print("\n=== Testing a Capped Replica Under Anti-Entropy ===")
+        client1 = self._start_node(1, 2, self.BASE_PORT)
+        client2 = self._start_node(2, 2, self.BASE_PORT, "shared", "256k")
+        self._assert(self._wait_until(lambda: self._converged([client1, client2]), 10),
+                     "Two-node cluster formed, node 2 capped at 256 KB")
+
+        value = "x" * 1024
+        with socket.create_connection(("localhost", client1.port), timeout=2) as sock:
+            for start in range(0, 1000, 100):
+                sock.sendall("".join(f"SET capped_{i:04d} {value}\n" for i in range(start, start + 100)).encode())
+                replies = b""
+                while replies.count(b"\n") < 100:
+                    chunk = sock.recv(65536)
+                    if not chunk:
+                        break
+                    replies += chunk
+        self._wait_until(lambda: client2.stats()["memory"][2] > 0, 5)
+        time.sleep(6)  # Past one anti-entropy round, which settles what replication missed
+
+        used, limit, evicted = client2.stats()["memory"]
+        self._assert(evicted > 0 and used <= limit, f"Node 2 evicted {evicted} keys to stay at {used} of {limit} bytes")
+        time.sleep(11)  # Two more rounds
+        used, limit, evicted_after = client2.stats()["memory"]
+        self._assert(used <= limit, f"Node 2 stays under its cap across anti-entropy rounds ({used} of {limit} bytes)")
+        self._assert(evicted_after == evicted,
+                     f"Anti-entropy copies no evicted key back ({evicted_after - evicted} evicted since)")
+
+        # A newer write to an evicted key still reaches the capped node
+        key = next(f"capped_{i:04d}" for i in range(1000) if client2.get(f"capped_{i:04d}") == "")
+        client1.set(key, "newer")
+        self._assert(self._wait_until(lambda: client2.get(key) == "newer", 5), "A newer write to an evicted key arrives")
+        self._stop_nodes()
+
+    def test_moved_redirects(self):
+        """Test that with replication_factor 1 exactly one node serves each key."""
+        print("\n=== Testing MOVED Redirects ===")
+        clients = [self._start_node(i, 1, self.BASE_PORT) for i in (1, 2, 3)]
+        self._assert(self._wait_until(lambda: self._converged(clients), 10), "Three-node cluster formed")
+        time.sleep(1)  # Let every node apply the final membership to its ring
+
+        keys = [f"moved_{i}" for i in range(60)]
+        served, redirects_agree = {}, True
+        for key in keys:
+            replies = {client.port: client.get(key) for client in clients}
+            owners = [port for port, reply in replies.items() if not reply.startswith("MOVED")]
+            served[key] = owners
+            if len(owners) != 1 or any(reply != f"MOVED 127.0.0.1:{owners[0]}"
+                                       for port, reply in replies.items() if port != owners[0]):
+                redirects_agree = False
+        self._assert(all(len(owners) == 1 for owners in served.values()), "Each key is served by exactly one node")
+        self._assert(redirects_agree, "Every other node answers MOVED with that owner's address")
+        self._assert(len({owners[0] for owners in served.values() if owners}) == 3,
+                     "Keys are spread over all three nodes")
+
+        for key in keys:
+            self._routed(clients, f"SET {key} v_{key}")
+        held = {client.port: set(client.get_all()) for client in clients}
+        self._assert(all(key in held[served[key][0]] and sum(key in h for h in held.values()) == 1 for key in keys),
+                     "Each SET is stored only on its owner")
+        return clients
+
+    def test_partition_handoff(self, clients):
+        """Test that a joining node receives its partitions and the old owners drop them."""
+        print("\n=== Testing Partition Hand-off ===")
+        keys = [f"handoff_{i}" for i in range(400)]
+        for key in keys:
+            reply, _ = self._routed(clients, f"SET {key} v_{key}")
+            if reply != "OK":
+                break
+        self._assert(reply == "OK", f"SET {len(keys)} keys through their owners: {reply}")
+
+        clients.append(self._start_node(4, 1, self.BASE_PORT))
+        self._assert(self._wait_until(lambda: self._converged(clients), 10), "Fourth node joined")
+
+        def settled():
+            held = [set(client.get_all()) & set(keys) for client in clients]
+            return held[3] and all(sum(key in h for h in held) == 1 for key in keys)
+        self._assert(self._wait_until(settled, 60), "The new node holds its keys and the old owners dropped them")
+
+        held = [set(client.get_all()) for client in clients]
+        print(f"Keys per node: {[len(h & set(keys)) for h in held]}")
+        missing = [key for key in keys if self._routed(clients, f"GET {key}")[0] != f"v_{key}"]
+        self._assert(not missing, f"Every key reads back from its owner ({len(missing)} missing)")
+        moved_to_new = [key for key in keys if key in held[3]]
+        self._assert(all(client.get(key) == f"MOVED 127.0.0.1:{clients[3].port}"
+                         for client in clients[:3] for key in moved_to_new),
+                     "Old owners redirect moved keys to the new node")
+        self._stop_nodes()
+
+    def run_all_tests(self):
+        """Run all cluster test cases, then stop the nodes and remove their files."""
+        try:
+            self.test_hlc_ordering()
+            self.test_capped_replica()
+            clients = self.test_moved_redirects()
+            self.test_partition_handoff(clients)
+        finally:
+            self._stop_nodes()
+            shutil.rmtree(self.workdir, ignore_errors=True)
+
+        print("\n=== Test Summary ===")
+        print(f"Passed: {self.results['passed']}")
+        print(f"Failed: {self.results['failed']}")
+
+        return self.results['failed'] == 0
+
+
 def check_node_availability():
     """Check if the KV store nodes are running."""
     client1 = KVClient(host=NODE1[0], port=NODE1[1])
@@ -350,7 +814,11 @@ def interactive_mode():
 
 
 if __name__ == "__main__":
-    if len(sys.argv) > 1 and sys.argv[1] == "test":
+    if len(sys.argv) > 1 and sys.argv[1] == "cluster":
+        # Start a cluster of kv_node processes and test it
+        runner = ClusterTestRunner(sys.argv[2] if len(sys.argv) > 2 else "./kv_node")
+        sys.exit(0 if runner.run_all_tests() else 1)
+    elif len(sys.argv) > 1 and sys.argv[1] == "test":
         # Run automated tests
         if check_node_availability():
             runner = TestRunner()
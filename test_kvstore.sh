@@ -211,5 +211,13 @@ echo -e "\n${YELLOW}Cleaning up...${NC}"
 kill_node 5008
 kill_node 5009
 
+# Persistence runs its own node on another port, restarting it between checks
+echo -e "\n${YELLOW}Testing persistence across restarts...${NC}"
+./test_persistence.sh ./kv_node
+
+# Clock ordering, MOVED routing and partition hand-off on kv_node clusters of their own
+echo -e "\n${YELLOW}Testing kv_node clusters...${NC}"
+python3 test_client.py cluster ./kv_node
+
 echo -e "\n${GREEN}All tests completed.${NC}"
 echo "Check node1.log and node2.log for details on node operation."
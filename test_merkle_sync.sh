@@ -24,9 +24,9 @@ sleep 2
 
 # Set some key-value pairs on node1
 echo "Setting keys on node1..."
-echo "SET key1 value1" | nc localhost 3000
-echo "SET key2 value2" | nc localhost 3000
-echo "SET key3 value3" | nc localhost 3000
+echo "SET key1 value1" | nc -w 1 localhost 3000
+echo "SET key2 value2" | nc -w 1 localhost 3000
+echo "SET key3 value3" | nc -w 1 localhost 3000
 
 # Wait for anti-entropy to run
 echo "Waiting for anti-entropy to synchronize nodes..."
@@ -34,13 +34,13 @@ sleep 6
 
 # Verify that node2 has the same keys
 echo "Verifying synchronization on node2..."
-echo -n "GET key1: " && echo "GET key1" | nc localhost 3001
-echo -n "GET key2: " && echo "GET key2" | nc localhost 3001
-echo -n "GET key3: " && echo "GET key3" | nc localhost 3001
+echo -n "GET key1: " && echo "GET key1" | nc -w 1 localhost 3001
+echo -n "GET key2: " && echo "GET key2" | nc -w 1 localhost 3001
+echo -n "GET key3: " && echo "GET key3" | nc -w 1 localhost 3001
 
 # Set a key on node2
 echo "Setting a new key on node2..."
-echo "SET key4 value4" | nc localhost 3001
+echo "SET key4 value4" | nc -w 1 localhost 3001
 
 # Wait for anti-entropy to run
 echo "Waiting for anti-entropy to synchronize nodes..."
@@ -48,7 +48,7 @@ sleep 6
 
 # Verify that node1 has the new key
 echo "Verifying node1 has the new key..."
-echo -n "GET key4: " && echo "GET key4" | nc localhost 3000
+echo -n "GET key4: " && echo "GET key4" | nc -w 1 localhost 3000
 
 # Clean up
 echo "Cleaning up..."
@@ -0,0 +1,161 @@
+#!/bin/bash
+
+# Restart test for persistence: writes must survive a killed node through the
+# write-ahead log alone, through a snapshot plus the log after it, and through a
+# newest snapshot that is corrupt on disk.
+#
+# Usage: ./test_persistence.sh [path to kv_node]
+
+KV_NODE=${1:-./kv_node}
+PORT=5108
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+FAILED=0
+DATA_DIR=$(mktemp -d)
+CONF="$DATA_DIR/node.conf"
+NODE_PID=
+
+pass() { echo -e "${GREEN}✓${NC} $1"; }
+fail() { echo -e "${RED}✗${NC} $1"; FAILED=1; }
+
+# Sends one text command and prints the reply line
+kv() {
+    exec 3<>/dev/tcp/127.0.0.1/$PORT || return 1
+    printf '%s\n' "$1" >&3
+    local reply
+    read -r -t 2 reply <&3
+    exec 3<&-
+    printf '%s' "${reply%$'\r'}"
+}
+
+write_conf() {
+    cat > "$CONF" <<EOF
+node_id = 1
+port = $PORT
+seeds = 127.0.0.1:$PORT
+replication_factor = 1
+data_dir = $DATA_DIR/data
+snapshot_interval_ms = $1
+EOF
+}
+
+start_node() {
+    "$KV_NODE" "$CONF" 1 >> "$DATA_DIR/node.log" 2>&1 &
+    NODE_PID=$!
+    for _ in $(seq 50); do
+        kv "GET ping" > /dev/null 2>&1 && return 0
+        kill -0 $NODE_PID 2>/dev/null || return 1
+        sleep 0.1
+    done
+    return 1
+}
+
+# Kills the node without letting it shut down cleanly
+crash_node() {
+    sleep 0.2  # Past the log's group-commit interval
+    kill -9 $NODE_PID 2>/dev/null
+    wait $NODE_PID 2>/dev/null
+}
+
+expect() {
+    local result
+    result=$(kv "GET $1")
+    if [ "$result" == "$2" ]; then
+        pass "$3"
+    else
+        fail "$3 (expected '$2', got '$result')"
+    fi
+}
+
+cleanup() {
+    [ -n "$NODE_PID" ] && kill -9 $NODE_PID 2>/dev/null
+    rm -rf "$DATA_DIR"
+}
+trap cleanup EXIT
+
+echo -e "${YELLOW}Testing recovery from the write-ahead log...${NC}"
+write_conf 3600000
+start_node || { fail "node did not start"; exit 1; }
+kv "SET logkey1 value1" > /dev/null
+kv "SET logkey2 value2" > /dev/null
+kv "SET logkey1 value1b" > /dev/null
+kv "DEL logkey2" > /dev/null
+crash_node
+start_node || { fail "node did not restart"; exit 1; }
+expect logkey1 value1b "SET survives a restart through the log"
+expect logkey2 "" "DEL survives a restart through the log"
+crash_node
+
+echo -e "\n${YELLOW}Testing recovery from a snapshot plus the log after it...${NC}"
+write_conf 500
+start_node || { fail "node did not restart"; exit 1; }
+kv "SET snapkey1 value1" > /dev/null
+kv "SET snapkey2 value2" > /dev/null
+sleep 1.5  # At least two snapshots
+kv "SET tailkey value3" > /dev/null
+kv "DEL snapkey2" > /dev/null
+crash_node
+SNAPSHOTS=$(ls "$DATA_DIR"/data/snapshot-*.snap 2>/dev/null | wc -l)
+if [ "$SNAPSHOTS" -eq 2 ]; then
+    pass "The newest snapshot and the one before it are kept"
+else
+    fail "Expected 2 snapshots on disk, found $SNAPSHOTS"
+fi
+write_conf 3600000
+start_node || { fail "node did not restart"; exit 1; }
+expect snapkey1 value1 "SET in a snapshot survives a restart"
+expect tailkey value3 "SET after the snapshot is replayed from the log"
+expect snapkey2 "" "DEL after the snapshot is replayed from the log"
+expect logkey1 value1b "SET from before the first snapshot survives"
+crash_node
+
+echo -e "\n${YELLOW}Testing recovery with a damaged section table...${NC}"
+NEWEST=$(ls "$DATA_DIR"/data/snapshot-*.snap | tail -1)
+# The first section's length (bytes 28-35 after the 20-byte header and its offset) set to 1 TB
+printf '\x00\x00\x00\x00\x00\x01\x00\x00' | dd of="$NEWEST" bs=1 seek=28 conv=notrunc status=none
+start_node || { fail "node did not restart"; exit 1; }
+if grep -q "Skipping snapshot.*section table" "$DATA_DIR/node.log"; then
+    pass "The snapshot with a section past the end of the file is skipped"
+else
+    fail "The damaged section table was not reported"
+fi
+expect snapkey1 value1 "SET survives through the previous snapshot"
+expect tailkey value3 "SET after the snapshots survives"
+crash_node
+: > "$DATA_DIR/node.log"
+
+echo -e "\n${YELLOW}Testing recovery with a corrupt newest snapshot...${NC}"
+printf 'CORRUPT!' | dd of="$NEWEST" conv=notrunc status=none
+start_node || { fail "node did not restart"; exit 1; }
+if grep -q "Skipping snapshot" "$DATA_DIR/node.log"; then
+    pass "The corrupt snapshot is skipped"
+else
+    fail "The corrupt snapshot was not reported"
+fi
+expect snapkey1 value1 "SET survives through the previous snapshot"
+expect tailkey value3 "SET after the snapshots survives"
+expect snapkey2 "" "DEL after the snapshots survives"
+crash_node
+
+echo -e "\n${YELLOW}Testing that recovery refuses to start with data missing...${NC}"
+PREVIOUS=$(ls "$DATA_DIR"/data/snapshot-*.snap | tail -2 | head -1)
+# The segments from before it were deleted, so nothing older can stand in
+printf 'CORRUPT!' | dd of="$PREVIOUS" conv=notrunc status=none
+if start_node; then
+    fail "Node started without the log its fallback needs"
+    crash_node
+else
+    pass "Node refuses to start without the log its fallback needs"
+fi
+
+if [ $FAILED -eq 0 ]; then
+    echo -e "\n${GREEN}All persistence tests passed.${NC}"
+else
+    echo -e "\n${RED}Some persistence tests failed; see the log below.${NC}"
+    cat "$DATA_DIR/node.log"
+fi
+exit $FAILED
@@ -0,0 +1,79 @@
+#ifndef VALUE_REF_HPP
+#define VALUE_REF_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+#include "storage/slab_allocator.hpp"
+
+// Immutable, reference-counted value bytes. The count lives in the same allocation
+// as the bytes, so copying a ValueRef is one atomic increment and never copies the
+// value: the store keeps one reference and a reader (a session writing the value to
+// its socket, a snapshot) holds another for as long as it needs the bytes, even if
+// the key is overwritten or deleted in the meantime.
+//
+// Blocks come from the SlabAllocator's size classes rather than the global heap. An
+// empty value needs no allocation and is represented by the null reference.
+class ValueRef {
+public:
+    ValueRef() = default;
+
+    static ValueRef make(std::string_view bytes) {
+        if (bytes.empty()) {
+            return ValueRef();
+        }
+        void* memory = SlabAllocator::instance().allocate(sizeof(Block) + bytes.size());
+        Block* block = new (memory) Block{{1}, static_cast<uint32_t>(bytes.size())};
+        std::memcpy(block->data(), bytes.data(), bytes.size());
+        return ValueRef(block);
+    }
+
+    ValueRef(const ValueRef& other) : block_(other.block_) {
+        if (block_) block_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ValueRef(ValueRef&& other) noexcept : block_(other.block_) {
+        other.block_ = nullptr;
+    }
+
+    ValueRef& operator=(ValueRef other) noexcept {
+        std::swap(block_, other.block_);
+        return *this;
+    }
+
+    ~ValueRef() {
+        if (block_ && block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            size_t bytes = sizeof(Block) + block_->size;
+            block_->~Block();
+            SlabAllocator::instance().deallocate(block_, bytes);
+        }
+    }
+
+    const char* data() const { return block_ ? block_->data() : ""; }
+    size_t size() const { return block_ ? block_->size : 0; }
+    bool empty() const { return size() == 0; }
+    std::string_view view() const { return std::string_view(data(), size()); }
+    std::string str() const { return std::string(view()); }
+
+    // Allocator bytes behind the value: header and size-class rounding included
+    size_t allocated_bytes() const {
+        return block_ ? SlabAllocator::chunk_size_of(sizeof(Block) + block_->size) : 0;
+    }
+
+private:
+    struct Block {
+        std::atomic<uint32_t> refs;
+        uint32_t size;
+
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+    };
+
+    explicit ValueRef(Block* block) : block_(block) {}
+
+    Block* block_ = nullptr;
+};
+
+#endif // VALUE_REF_HPP